@@ -0,0 +1,12 @@
+#ifndef ADAPTIVE_UTILS_H
+#define ADAPTIVE_UTILS_H
+
+#include "opencl_utils.h"
+
+#define KRONROD_POINTS 15
+#define MAX_INTERVALS (1 << 22)
+#define MAX_ROUNDS 64
+
+int run_adaptive(OpenCLEngine* engine, double a, double b, double tolerance, int func, double* final_result, double* exact_value, double* error, long long* evaluations, double* elapsed_time);
+
+#endif // ADAPTIVE_UTILS_H
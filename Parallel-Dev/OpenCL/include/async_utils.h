@@ -0,0 +1,40 @@
+#ifndef ASYNC_UTILS_H
+#define ASYNC_UTILS_H
+
+#include <pthread.h>
+#include <CL/cl.h>
+#include "opencl_utils.h"
+
+#define MAX_CHAIN 8
+
+typedef struct IntegralFuture IntegralFuture;
+typedef void (*FutureCallback)(IntegralFuture* future, void* user_data);
+
+// Handle of an integration in flight: the fused kernel, the reduction passes
+// and the non-blocking read of the final pair, chained by events on the
+// engine's asynchronous queue. Nothing blocks until future_get.
+struct IntegralFuture {
+    OpenCLEngine* engine;
+    cl_kernel fused_kernel;
+    cl_kernel final_sum_kernel;
+    cl_mem buffers[MAX_CHAIN];
+    int buffer_count;
+    cl_event events[MAX_CHAIN];     // kernel events, in launch order
+    int event_count;
+    cl_event read_event;
+    double pair[2];
+    double factor;
+    pthread_mutex_t lock;           // guards complete and status, written by the read callback
+    pthread_cond_t done;
+    int complete;
+    cl_int status;                  // execution status of the read, negative on failure
+    FutureCallback callback;
+    void* user_data;
+};
+
+IntegralFuture* range_sum_async(OpenCLEngine* engine, double a, double h, long long start, long long end, long long size, int mode, int func, FutureCallback callback, void* user_data);
+IntegralFuture* integrate_async(OpenCLEngine* engine, double a, double b, long long size, int mode, int func, FutureCallback callback, void* user_data);
+int future_ready(IntegralFuture* future);
+int future_get(IntegralFuture* future, double* result, double* kernel_time);
+
+#endif // ASYNC_UTILS_H
@@ -0,0 +1,11 @@
+#ifndef BATCH_UTILS_H
+#define BATCH_UTILS_H
+
+#include "opencl_utils.h"
+#include "input_utils.h"
+
+#define MAX_GROUPS_PER_JOB 64
+
+int run_batch(OpenCLEngine* engine, const Params* params, int count, double* results, double* elapsed_time);
+
+#endif // BATCH_UTILS_H
@@ -0,0 +1,45 @@
+#ifndef BENCH_UTILS_H
+#define BENCH_UTILS_H
+
+#include <stdio.h>
+#include "input_utils.h"
+
+#define BENCH_CSV 0
+#define BENCH_JSON 1
+
+#define MAX_BENCH_VALUES 16
+
+// Sweep read from a --bench spec file. Every combination of backend,
+// precision, mode, func and n (geometric from n_start to n_stop) is measured.
+// Without a precisions line the --precision option applies.
+typedef struct {
+    int backends[MAX_BENCH_VALUES];
+    int backend_count;
+    int modes[MAX_BENCH_VALUES];
+    int mode_count;
+    int funcs[MAX_BENCH_VALUES];
+    int func_count;
+    long long n_start;
+    long long n_stop;
+    long long n_factor;
+    double a;
+    double b;
+    int warmup;
+    int repeat;
+    int format;
+    int precisions[MAX_BENCH_VALUES];
+    int precision_count;
+} BenchSpec;
+
+typedef struct {
+    double median;
+    double p95;
+    double stddev;
+} BenchStats;
+
+int read_bench_spec(const char *filename, BenchSpec *spec);
+double measure_once(int backend, const Options *options, double a, double b, long long n, int mode, int func, double *kernel_time, double *result);
+void summarize_samples(double *samples, int count, BenchStats *stats);
+int run_bench(const BenchSpec *spec, const Options *options, FILE *out);
+
+#endif // BENCH_UTILS_H
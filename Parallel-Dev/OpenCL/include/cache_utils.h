@@ -0,0 +1,11 @@
+#ifndef CACHE_UTILS_H
+#define CACHE_UTILS_H
+
+#include <CL/cl.h>
+#include "hash_utils.h"
+
+unsigned long long hash_device(cl_device_id device_id);
+cl_program load_program_binary(cl_context context, cl_device_id device_id, const char *path, const char *options);
+int save_program_binary(cl_program program, const char *path);
+
+#endif // CACHE_UTILS_H
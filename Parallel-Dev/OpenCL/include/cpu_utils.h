@@ -0,0 +1,22 @@
+#ifndef CPU_UTILS_H
+#define CPU_UTILS_H
+
+#define EXPR_CFLAGS "-O3 -march=native -ffast-math -fopenmp -shared -fPIC"
+
+// Integrand compiled from an --expr string into a shared object.
+typedef struct {
+    void *handle;
+    double (*integrand)(double);
+    double (*weighted_sum)(double, double, long long, double, double);
+} CompiledExpression;
+
+unsigned long long hash_host_cpu(unsigned long long key);
+double integrableFunction(double x, int func);
+double weighted_interior_sum(double a, double h, long long n, int func, double w_odd, double w_even);
+double weighted_range_sum(double a, double h, long long start, long long end, long long n, int mode, int func, const CompiledExpression *compiled);
+int compile_expression(const char *expr, CompiledExpression *compiled);
+void release_expression(CompiledExpression *compiled);
+double calculate_integral(double h, long long size, int mode, int func, double a, double b, const CompiledExpression *expr);
+int run_cpu(const CompiledExpression *compiled, double a, double b, long long size, int mode, int func, double *final_result, double *elapsed_time);
+
+#endif // CPU_UTILS_H
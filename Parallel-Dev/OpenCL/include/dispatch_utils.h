@@ -0,0 +1,32 @@
+#ifndef DISPATCH_UTILS_H
+#define DISPATCH_UTILS_H
+
+#include "input_utils.h"
+#include "cpu_utils.h"
+
+#define DISPATCH_FILE "dispatch_models.txt"
+#define CALIBRATION_SMALL_N 1000
+#define CALIBRATION_LARGE_N 10000000
+#define CALIBRATION_REPEATS 3
+
+// Linear cost model per backend: seconds = overhead + per_point * points.
+// The OpenCL overhead covers device query, context, program load and
+// teardown, so a request pays it once no matter how many jobs it holds.
+// Without a working OpenCL device the CPU is always chosen.
+typedef struct {
+    double cpu_overhead;
+    double cpu_per_point;
+    double opencl_overhead;
+    double opencl_per_point;
+    int opencl_available;
+} DispatchModel;
+
+int load_dispatch_model(unsigned long long key, DispatchModel *model);
+int save_dispatch_model(unsigned long long key, const DispatchModel *model);
+int calibrate_dispatch(DispatchModel *model, const Options *options);
+void get_dispatch_model(DispatchModel *model, const Options *options);
+int choose_backend(const DispatchModel *model, int jobs, long long points);
+long long dispatch_crossover(const DispatchModel *model);
+int resolve_backend(const Options *options, int jobs, long long points);
+
+#endif // DISPATCH_UTILS_H
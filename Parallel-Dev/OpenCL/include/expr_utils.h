@@ -0,0 +1,12 @@
+#ifndef EXPR_UTILS_H
+#define EXPR_UTILS_H
+
+#include <stddef.h>
+
+#define MAX_EXPR_CODE 4096
+
+int expr_to_code(const char *expr, char *code, size_t code_size, char *error, size_t error_size);
+char* expr_opencl_prefix(const char *code);
+char* expr_c_source(const char *code);
+
+#endif // EXPR_UTILS_H
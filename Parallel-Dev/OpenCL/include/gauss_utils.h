@@ -0,0 +1,12 @@
+#ifndef GAUSS_UTILS_H
+#define GAUSS_UTILS_H
+
+#include "opencl_utils.h"
+
+#define GAUSS_MAX_ORDER 64
+#define GAUSS_NEWTON_STEPS 100
+
+void gauss_legendre_rule(int order, double* nodes, double* weights);
+int run_gauss_legendre(OpenCLEngine* engine, double a, double b, long long panels, int order, int func, double* final_result, double* exact_value, double* error, double* elapsed_time);
+
+#endif // GAUSS_UTILS_H
@@ -0,0 +1,13 @@
+#ifndef HASH_UTILS_H
+#define HASH_UTILS_H
+
+#include <stddef.h>
+
+#define CACHE_DIR_ENV "INTEGRAL_CACHE_DIR"
+#define DEFAULT_CACHE_DIR "cache"
+
+unsigned long long hash_bytes(const void *data, size_t length, unsigned long long seed);
+const char* get_cache_dir(void);
+void get_cache_path(char *path, size_t path_size, const char *prefix, unsigned long long key, const char *extension);
+
+#endif // HASH_UTILS_H
@@ -1,19 +1,59 @@
-#ifndef INPUT_UTILS_H
-#define INPUT_UTILS_H
-
-typedef struct {
-    double a;
-    double b;
-    int n;
-    int mode;
-    int func;
-} Params;
-
-void get_points(double array[], double a, double b, int size, double h);
-void print_usage(const char *prog_name);
-void print_help(const char *prog_name);
-double exact_integral(double a, double b, int func);
-int read_params(const char *filename, Params *params);
-void least_squares(double *x, double *y, int n, double *a, double *b);
-
-#endif // INPUT_UTILS_H
+#ifndef INPUT_UTILS_H
+#define INPUT_UTILS_H
+
+typedef struct {
+    double a;
+    double b;
+    long long n;
+    int mode;
+    int func;
+} Params;
+
+#define DEFAULT_REPLICATES 16
+#define DEFAULT_SEED 0x5eedULL
+
+#define BACKEND_OPENCL 0
+#define BACKEND_CPU 1
+#define BACKEND_AUTO 2  // chosen per request from the calibrated dispatch model
+
+#define PRECISION_FP64 0
+#define PRECISION_FP32 1    // float throughout, runs without cl_khr_fp64
+#define PRECISION_MIXED 2   // float integrand, double accumulation
+
+#define TUNE_OFF 0      // keep the built-in launch geometry
+#define TUNE_AUTO 1     // load the tuning file, sweep on first use
+#define TUNE_FORCE 2    // sweep again and overwrite the stored entry
+
+// Options shared by every mode, removed from argv before dispatching.
+typedef struct {
+    int compensated;
+    long long chunk_size;
+    const char *expr;
+    int replicates;
+    unsigned long long seed;
+    int tune;
+    int multi_device;
+    int cpu_share;
+    int backend;
+    int calibrate;
+    int precision;
+    int native_math;
+    const char *trace;      // Chrome trace output, or NULL
+    int vector_width;       // 0: the device's preferred width
+} Options;
+
+void print_usage(const char *prog_name);
+void print_help(const char *prog_name);
+double exact_integral(double a, double b, int func);
+int consume_flag(int *argc, char *argv[], const char *flag);
+const char* consume_option(int *argc, char *argv[], const char *option);
+int parse_backend(const char *name);
+int parse_precision(const char *name);
+const char* precision_name(int precision);
+int parse_options(int *argc, char *argv[], Options *options);
+void neumaier_add(double *sum, double *comp, double value);
+int read_params(const char *filename, Params **params);
+double rule_factor(int mode, double h);
+void least_squares(double *x, double *y, int n, double *a, double *b);
+
+#endif // INPUT_UTILS_H
@@ -0,0 +1,72 @@
+#ifndef INTEGRATE_H
+#define INTEGRATE_H
+
+// libintegrate: the integration engine behind both command line programs,
+// for embedding without spawning a process and parsing its output.
+// This header is self-contained; nothing else from include/ is needed.
+
+#define INTEGRATE_API_VERSION 1
+
+#define INTEGRATE_BACKEND_OPENCL 0
+#define INTEGRATE_BACKEND_CPU 1
+#define INTEGRATE_BACKEND_AUTO 2    // per call, from the calibrated crossover
+
+#define INTEGRATE_MODE_SIMPSON 0
+#define INTEGRATE_MODE_RECTANGLE 1
+#define INTEGRATE_MODE_TRAPEZOIDAL 2
+
+#define INTEGRATE_PRECISION_FP64 0
+#define INTEGRATE_PRECISION_FP32 1
+#define INTEGRATE_PRECISION_MIXED 2
+
+// Fixed when the context is created. Start from integrate_default_config
+// so that fields added in later versions keep their defaults.
+typedef struct {
+    int backend;
+    const char *kernel_file;    // NULL: kernels/integral_kernel.cl under the working directory
+    const char *expr;       // expression in x replacing func, or NULL; borrowed, must outlive the context
+    int compensated;
+    long long chunk_size;   // 0: the whole range in one launch
+    int precision;
+    int native_math;
+    int tune;               // 0: off, 1: load or sweep once, 2: sweep again
+    int calibrate;          // re-measure the crossover used by the auto backend
+} IntegrateConfig;
+
+// One integral of func (0: sin, 1: cos, 2: exp, 3: sqrt, 4: log) over
+// [a, b] with n intervals.
+typedef struct {
+    double a;
+    double b;
+    long long n;
+    int mode;
+    int func;
+} IntegrateJob;
+
+typedef struct {
+    double elapsed_time;    // integration only, device time on OpenCL
+    int backend;            // the backend that ran the call
+} IntegrateStats;
+
+typedef struct IntegrateContext IntegrateContext;
+
+void integrate_default_config(IntegrateConfig *config);
+
+// The OpenCL engine is created on first use and kept warm until destroy.
+// Returns NULL if the configuration is invalid or the expression does not
+// parse. The expression is compiled for a backend on its first use there, so
+// a compile or device failure is reported by that integrate_run/batch call.
+// The context keeps the config's kernel_file and expr pointers, not copies.
+IntegrateContext* integrate_create(const IntegrateConfig *config);
+void integrate_destroy(IntegrateContext *context);
+
+// Return 0 on success and -1 on an invalid job or a failure in the backend
+// (no OpenCL platform or device, a build or launch error, ...), reported on
+// stderr; the host process is never terminated. stats may be NULL.
+int integrate_run(IntegrateContext *context, const IntegrateJob *job, double *result, IntegrateStats *stats);
+int integrate_batch(IntegrateContext *context, const IntegrateJob *jobs, int count, double *results, IntegrateStats *stats);
+
+// Closed-form value for the built-in functions.
+double integrate_exact(double a, double b, int func);
+
+#endif // INTEGRATE_H
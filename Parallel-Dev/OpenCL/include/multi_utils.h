@@ -0,0 +1,34 @@
+#ifndef MULTI_UTILS_H
+#define MULTI_UTILS_H
+
+#include <CL/cl.h>
+#include "opencl_utils.h"
+#include "cpu_utils.h"
+
+#define MAX_DEVICES 16
+#define WARMUP_POINTS (1LL << 12)
+#define CHUNKS_PER_WORKER 16
+#define MIN_MULTI_CHUNK (1LL << 16)
+
+// One worker per OpenCL device, plus the CPU backend when engine is NULL.
+// Each worker owns the chunk indices [next_chunk, end_chunk); an idle worker
+// steals the back half of the largest remaining range. A worker whose launch
+// fails stops, and the others finish its chunks.
+typedef struct {
+    OpenCLEngine *engine;
+    char name[128];
+    double throughput;  // calibrated points per second
+    long long next_chunk;
+    long long end_chunk;
+    long long chunks_done;
+    long long chunks_stolen;
+    double sum;
+    double comp;
+    int failed;
+} MultiWorker;
+
+int multi_init(MultiWorker **workers, const char *kernel_file, const Options *options);
+void multi_destroy(MultiWorker *workers, int count);
+int run_multi(MultiWorker *workers, int count, const CompiledExpression *compiled, double a, double b, long long size, int mode, int func, long long chunk_size, double *final_result, double *elapsed_time);
+
+#endif // MULTI_UTILS_H
@@ -1,12 +1,68 @@
-#ifndef OPENCL_UTILS_H
-#define OPENCL_UTILS_H
-
-#include <CL/cl.h>
-
-char* readKernelSource(const char* filename, size_t* length);
-cl_kernel create_kernel(cl_program program, int mode, cl_int* ret);
-cl_kernel select_function_kernel(cl_program program, int func, cl_int* ret);
-double run_algorithm(double a, double b, int size, int mode, int func, double* final_result, double* exact_value, double* error);
-double run_simpson_nd(double *lower, double *upper, int *n, int dim, int func, double *result);
-
-#endif // OPENCL_UTILS_H
+#ifndef OPENCL_UTILS_H
+#define OPENCL_UTILS_H
+
+#include <CL/cl.h>
+#include "input_utils.h"
+
+#define KERNEL_FILE "kernels/integral_kernel.cl"
+
+#define LOCAL_SIZE 128
+#define DEFAULT_ITEMS_PER_THREAD 16
+#define MAX_WORK_GROUPS 65536
+#define REDUCE_ITEMS_PER_THREAD 8
+#define NUM_STREAMS 3
+#define MAX_DIM 32
+
+// Platform, device, context, queue and the built program are created once by
+// engine_init and shared by every integration until engine_destroy. The
+// engine, run and batch functions report failures on stderr and return -1
+// (or NULL) instead of exiting, so an embedding process survives them.
+typedef struct {
+    cl_platform_id platform_id;
+    cl_device_id device_id;
+    cl_context context;
+    cl_command_queue command_queue;
+    cl_command_queue async_queue;   // out-of-order when the device supports it, see async_utils
+    cl_program program;
+    int compensated;    // Neumaier-compensated accumulation in every reduction
+    long long chunk_size;   // points per launch in chunked mode, 0 = one launch
+    unsigned long long program_key; // device + source + build options, see build_program
+    size_t local_size;  // work-group size of every reducing kernel, a power of two
+    int items_per_thread;   // points (fused_integral: vectors) per work-item before the grid is capped
+    int vector_width;   // points per fused_integral vector, -DVECTOR_WIDTH or 1
+    size_t real_size;   // sizeof the kernels' real_t: float in the fp32 variant, else double
+} OpenCLEngine;
+
+char* readKernelSource(const char* filename, size_t* length);
+int check_build(cl_program program, cl_device_id device_id, cl_int ret);
+unsigned long long program_cache_key(cl_device_id device_id, const char* source, size_t source_size, const char* options);
+cl_program build_program(OpenCLEngine* engine, const char* source, size_t source_size, const char* options);
+int device_supports_fp64(cl_device_id device_id);
+int select_default_device(cl_platform_id* platform_id, cl_device_id* device_id);
+int engine_create(OpenCLEngine* engine, cl_platform_id platform_id, cl_device_id device_id, const char* kernel_file, const char* prefix, const char* build_options);
+int engine_init_with_prefix(OpenCLEngine* engine, const char* kernel_file, const char* prefix);
+int engine_init(OpenCLEngine* engine, const char* kernel_file);
+void get_build_options(const Options* options, char* buffer, size_t buffer_size);
+int get_vector_width(cl_device_id device_id, const Options* options);
+int engine_init_device(OpenCLEngine* engine, cl_platform_id platform_id, cl_device_id device_id, const char* kernel_file, const Options* options);
+int options_program_key(const char* kernel_file, const Options* options, unsigned long long* key);
+int engine_init_options(OpenCLEngine* engine, const char* kernel_file, const Options* options);
+void get_device_description(OpenCLEngine* engine, char* buffer, size_t buffer_size);
+void engine_destroy(OpenCLEngine* engine);
+double event_seconds(cl_event event);
+cl_int set_real_arg(const OpenCLEngine* engine, cl_kernel kernel, cl_uint index, double value);
+cl_mem create_real_buffer(const OpenCLEngine* engine, const double* values, size_t count, cl_int* ret);
+cl_int write_real_buffer(const OpenCLEngine* engine, cl_command_queue queue, cl_mem mem, const double* values, size_t count, cl_event* event);
+void release_mem(cl_mem mem);
+void widen_reals(const OpenCLEngine* engine, double* values, size_t count);
+int reduce_on_device(OpenCLEngine* engine, cl_mem partial_sums_mem, size_t count, double* sum, double* kernel_time);
+size_t kernel_global_size(const OpenCLEngine* engine, cl_long points);
+size_t fused_global_size(const OpenCLEngine* engine, cl_long points);
+int set_fused_args(const OpenCLEngine* engine, cl_kernel kernel, double a, double h, cl_long start, cl_long end, cl_long n, int mode, int func, int compensated, cl_mem output_mem, size_t local_size);
+int fused_range_sum(OpenCLEngine* engine, double a, double h, long long start, long long end, long long size, int mode, int func, double* sum, double* elapsed_time);
+int fused_sum(OpenCLEngine* engine, double a, double h, long long size, int mode, int func, double* sum, double* elapsed_time);
+int chunked_sum(OpenCLEngine* engine, double a, double h, long long size, int mode, int func, double* sum, double* elapsed_time);
+int run_algorithm(OpenCLEngine* engine, double a, double b, long long size, int mode, int func, double* final_result, double* exact_value, double* error, double* elapsed_time);
+int run_simpson_nd(OpenCLEngine* engine, double *lower, double *upper, long long *n, int dim, int func, double *result, double *elapsed_time);
+
+#endif // OPENCL_UTILS_H
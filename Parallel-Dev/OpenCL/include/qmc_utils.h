@@ -0,0 +1,11 @@
+#ifndef QMC_UTILS_H
+#define QMC_UTILS_H
+
+#include "opencl_utils.h"
+
+#define QMC_HALTON 0
+#define QMC_RANDOM 1
+
+int run_qmc(OpenCLEngine* engine, double *lower, double *upper, int dim, long long samples, int func, int sequence, int replicates, unsigned long long seed, double *result, double *std_error, double *elapsed_time);
+
+#endif // QMC_UTILS_H
@@ -0,0 +1,11 @@
+#ifndef ROMBERG_UTILS_H
+#define ROMBERG_UTILS_H
+
+#include "opencl_utils.h"
+
+#define ROMBERG_MIN_LEVELS 4
+#define ROMBERG_MAX_LEVELS 30
+
+int run_romberg(OpenCLEngine* engine, double a, double b, double tolerance, int func, double* final_result, double* exact_value, double* error, long long* evaluations, int* levels, double* elapsed_time);
+
+#endif // ROMBERG_UTILS_H
@@ -0,0 +1,28 @@
+#ifndef SAMPLE_UTILS_H
+#define SAMPLE_UTILS_H
+
+#include "opencl_utils.h"
+
+// Optional header: SAMPLE_MAGIC, then the doubles a and b, zero padded to
+// SAMPLE_HEADER_SIZE bytes. Without it the file is raw native doubles.
+#define SAMPLE_MAGIC "INTSAMP1"
+#define SAMPLE_HEADER_SIZE 64
+#define SAMPLE_CHUNK_POINTS (1 << 22)
+#define SAMPLE_BUFFERS 2
+
+// A read-only mapping of a sample file.
+typedef struct {
+    void *map;
+    size_t map_size;
+    const double *samples;
+    long long count;
+    int has_range;      // a and b came from the header
+    double a;
+    double b;
+} SampleFile;
+
+int open_samples(const char* path, SampleFile* file);
+void close_samples(SampleFile* file);
+int run_samples(OpenCLEngine* engine, const SampleFile* file, double a, double b, int mode, double* final_result, double* elapsed_time);
+
+#endif // SAMPLE_UTILS_H
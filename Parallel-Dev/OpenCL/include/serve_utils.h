@@ -0,0 +1,23 @@
+#ifndef SERVE_UTILS_H
+#define SERVE_UTILS_H
+
+#include "opencl_utils.h"
+#include "input_utils.h"
+
+#define SERVE_MAX_CLIENTS 64
+#define SERVE_MAX_BATCH 1024
+#define SERVE_BATCH_WINDOW_US 200
+#define SERVE_LINE_SIZE 512
+#define SERVE_LATENCY_WINDOW 65536      // latency statistics cover the most recent requests
+#define SERVE_MAX_PENDING (1 << 20)     // unsent reply bytes before a client counts as stalled
+
+// One queued request: where the answer goes and when the line arrived.
+typedef struct {
+    Params params;
+    int fd;
+    double arrival;
+} ServeRequest;
+
+int run_server(OpenCLEngine* engine, const Options* options, const char* socket_path);
+
+#endif // SERVE_UTILS_H
@@ -0,0 +1,12 @@
+#ifndef SWEEP_UTILS_H
+#define SWEEP_UTILS_H
+
+#include "opencl_utils.h"
+
+#define MAX_GROUPS_PER_ROW 64
+
+int read_sweep_values(const char *filename, double **values);
+double sweep_exact(double a, double b, double p, int func);
+int run_sweep(OpenCLEngine* engine, double a, double b, long long n, int mode, int func, const double* values, int count, double* results, double* elapsed_time);
+
+#endif // SWEEP_UTILS_H
@@ -0,0 +1,12 @@
+#ifndef TANH_SINH_UTILS_H
+#define TANH_SINH_UTILS_H
+
+#include "opencl_utils.h"
+
+#define TANH_SINH_T_MAX 4.0
+#define TANH_SINH_MIN_LEVELS 3
+#define TANH_SINH_MAX_LEVELS 16
+
+int run_tanh_sinh(OpenCLEngine* engine, double a, double b, double tolerance, int func, double* final_result, double* exact_value, double* error, long long* evaluations, int* levels, double* elapsed_time);
+
+#endif // TANH_SINH_UTILS_H
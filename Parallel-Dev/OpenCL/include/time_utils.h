@@ -1,8 +1,8 @@
-#ifndef TIME_UTILS_H
-#define TIME_UTILS_H
-
-#include <time.h>
-
-double get_elapsed_time(struct timespec start, struct timespec end);
-
-#endif // TIME_UTILS_H
+#ifndef TIME_UTILS_H
+#define TIME_UTILS_H
+
+#include <time.h>
+
+double get_elapsed_time(struct timespec start, struct timespec end);
+
+#endif // TIME_UTILS_H
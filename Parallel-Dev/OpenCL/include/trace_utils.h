@@ -0,0 +1,33 @@
+#ifndef TRACE_UTILS_H
+#define TRACE_UTILS_H
+
+#include <CL/cl.h>
+
+#define TRACE_ENV "INTEGRAL_TRACE"
+#define TRACE_MAX_LANES 64
+
+// One recorded span. Host phases use the host clock; device commands keep
+// their profiling timestamps (ns) until the trace is written.
+typedef struct {
+    const char *name;   // must outlive the trace (string literals)
+    int device;         // 0: host phase, 1: device command
+    double host_start;  // µs since trace_open
+    double host_end;
+    cl_command_queue queue;
+    cl_device_id device_id;
+    cl_ulong queued;
+    cl_ulong submit;
+    cl_ulong start;
+    cl_ulong end;
+} TraceSpan;
+
+void trace_open(const char *path);
+int trace_enabled(void);
+double trace_now(void);
+void trace_host(const char *name, double start);
+void trace_command(const char *name, cl_event event);
+cl_event* trace_slot(cl_event *event);
+void trace_collect(const char *name, cl_event *event);
+void trace_close(void);
+
+#endif // TRACE_UTILS_H
@@ -0,0 +1,20 @@
+#ifndef TUNE_UTILS_H
+#define TUNE_UTILS_H
+
+#include <stddef.h>
+#include "opencl_utils.h"
+
+#define TUNING_FILE "tuning.txt"
+#define TUNE_KERNEL "fused_integral"
+#define TUNE_POINTS (1LL << 24)
+#define TUNE_REPEATS 3
+#define MAX_TUNE_LOCAL_SIZE 1024
+#define MAX_ITEMS_PER_THREAD 256
+
+int load_tuning(unsigned long long key, const char *kernel_name, size_t *local_size, int *items_per_thread);
+int save_tuning(unsigned long long key, const char *kernel_name, size_t local_size, int items_per_thread);
+size_t tuning_size_limit(OpenCLEngine *engine, size_t *preferred_multiple);
+double autotune_engine(OpenCLEngine *engine);
+int apply_tuning(OpenCLEngine *engine, int tune);
+
+#endif // TUNE_UTILS_H
@@ -1,145 +1,605 @@
-__kernel void final_sum_kernel(__global double* input, __global double* output, __local double* local_mem) {
-    int local_id = get_local_id(0);
-    int global_id = get_global_id(0);
-    int local_size = get_local_size(0);
-
-    local_mem[local_id] = input[global_id];
-    barrier(CLK_LOCAL_MEM_FENCE);
-
-    for (int stride = local_size / 2; stride > 0; stride >>= 1) {
-        if (local_id < stride) {
-            local_mem[local_id] += local_mem[local_id + stride];
-        }
-        barrier(CLK_LOCAL_MEM_FENCE);
-    }
-
-    if (local_id == 0) {
-        output[get_group_id(0)] = local_mem[0];
-    }
-}
-
-__kernel void sin_kernel(__global double* x, __global double* results) {
-    int gid = get_global_id(0);
-    results[gid] = sin(x[gid]);
-}
-
-__kernel void cos_kernel(__global double* x, __global double* results) {
-    int gid = get_global_id(0);
-    results[gid] = cos(x[gid]);
-}
-
-__kernel void exp_kernel(__global double* x, __global double* results) {
-    int gid = get_global_id(0);
-    results[gid] = exp(x[gid]);
-}
-
-__kernel void sqrt_kernel(__global double* x, __global double* results) {
-    int gid = get_global_id(0);
-    results[gid] = sqrt(x[gid]);
-}
-
-__kernel void log_kernel(__global double* x, __global double* results) {
-    int gid = get_global_id(0);
-    results[gid] = log(x[gid]);
-}
-
-__kernel void simpson_integral(__global double* results, __global double* integral_results, int n) {
-    int gid = get_global_id(0);
-    double local_result = 0.0;
-
-    if (gid == 0) {
-        local_result = results[0];
-    } else if (gid == n) {
-        local_result = results[n];
-    } else if (gid % 2 == 1) {
-        local_result = 4 * results[gid];
-    } else if (gid % 2 == 0) {
-        local_result = 2 * results[gid];
-    }
-
-    integral_results[gid] = local_result;
-}
-
-__kernel void rectangle_integral(__global double* results, __global double* integral_results, int n) {
-    int gid = get_global_id(0);
-    double local_result = 0.0;
-
-    if (gid == 0) {
-        local_result = results[0];
-    } else if (gid == n) {
-        local_result = results[n];
-    } else if (gid < n) {
-        local_result = results[gid];
-    }
-
-    integral_results[gid] = local_result;
-}
-
-__kernel void trapezoidal_integral(__global double* results, __global double* integral_results, int n) {
-    int gid = get_global_id(0);
-    double local_result = 0.0;
-
-    if (gid == 0) {
-        local_result = results[0];
-    } else if (gid == n) {
-        local_result = results[n];
-    } else if (gid < n) {
-        local_result = 2 * results[gid];
-    }
-
-    integral_results[gid] = local_result;
-}
-
-__kernel void simpson_kernel(__global double* lower, __global double* upper, __global int* n, __global double* results, int dim, int func) {
-    int gid = get_global_id(0);
-    int total_points = 1;
-    for (int i = 0; i < dim; i++) {
-        total_points *= n[i] + 1;
-    }
-
-    __local double h[32];
-    __local double x[32];
-    __local int index[32];
-
-    if (dim > 32) {
-        return;
-    }
-
-    for (int i = 0; i < dim; i++) {
-        h[i] = (upper[i] - lower[i]) / n[i];
-    }
-
-    int temp = gid;
-    double coeff = 1.0;
-
-    for (int j = 0; j < dim; j++) {
-        index[j] = temp % (n[j] + 1);
-        temp /= (n[j] + 1);
-        x[j] = lower[j] + index[j] * h[j];
-        if (index[j] == 0 || index[j] == n[j]) {
-            coeff *= 1.0;
-        } else if (index[j] % 2 == 1) {
-            coeff *= 4.0;
-        } else {
-            coeff *= 2.0;
-        }
-    }
-
-    double f_val;
-    switch (func) {
-        case 0:
-            f_val = exp(-x[0] * x[0] - x[1] * x[1] - x[2] * x[2]);
-            break;
-        case 1:
-            f_val = sin(x[0] + x[1] + x[2]);
-            break;
-        case 2:
-            f_val = cos(x[0] * x[1] * x[2]);
-            break;
-        default:
-            f_val = 1.0;
-            break;
-    }
-
-    results[gid] = coeff * f_val;
-}
+// Precision variant, chosen at build time by the host (--precision):
+//   fp64 (default)   - integrand and accumulation in double
+//   PRECISION_MIXED  - integrand in float, accumulation in double
+//   PRECISION_FP32   - everything in float, so the program builds on devices
+//                      without cl_khr_fp64
+// real_t is the type of every kernel argument, buffer and reduction; the host
+// passes and reads values of the same width (engine->real_size).
+// NATIVE_MATH maps the float built-ins onto native_* versions.
+#ifdef PRECISION_FP32
+#define REAL_TYPE float
+typedef float2 real2_t;
+#else
+#define REAL_TYPE double
+typedef double2 real2_t;
+#endif
+typedef REAL_TYPE real_t;
+
+#if defined(PRECISION_FP32) || defined(PRECISION_MIXED)
+#define EVAL_TYPE float
+#else
+#define EVAL_TYPE double
+#endif
+typedef EVAL_TYPE eval_t;
+
+// Neumaier's variant of Kahan summation: the rounding error of every
+// addition is collected in comp and added back once at the end.
+void neumaier_add(real_t* sum, real_t* comp, real_t value) {
+    real_t t = *sum + value;
+    if (fabs(*sum) >= fabs(value)) {
+        *comp += (*sum - t) + value;
+    } else {
+        *comp += (value - t) + *sum;
+    }
+    *sum = t;
+}
+
+#if defined(NATIVE_MATH) && (defined(PRECISION_FP32) || defined(PRECISION_MIXED))
+#define EVAL_SIN native_sin
+#define EVAL_COS native_cos
+#define EVAL_EXP native_exp
+#define EVAL_SQRT native_sqrt
+#define EVAL_LOG native_log
+#else
+#define EVAL_SIN sin
+#define EVAL_COS cos
+#define EVAL_EXP exp
+#define EVAL_SQRT sqrt
+#define EVAL_LOG log
+#endif
+
+// With --expr the host prepends USER_EXPRESSION, an expression in x and p
+// (p is 1 outside --sweep), and defines USER_INTEGRAND.
+#ifdef USER_INTEGRAND
+real_t user_param_integrand(real_t x, real_t p) {
+    return USER_EXPRESSION;
+}
+
+real_t user_integrand(real_t x) {
+    return user_param_integrand(x, 1.0);
+}
+#endif
+
+// Tree reduction of one (sum, comp) pair per work-item. Work-item 0 writes the
+// group's pair to output[group].
+void reduce_group(__local real_t* local_sum, __local real_t* local_comp, real_t sum, real_t comp, int compensated, __global real2_t* output) {
+    int local_id = get_local_id(0);
+    int local_size = get_local_size(0);
+
+    local_sum[local_id] = sum;
+    local_comp[local_id] = comp;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int stride = local_size / 2; stride > 0; stride >>= 1) {
+        if (local_id < stride) {
+            if (compensated) {
+                real_t s = local_sum[local_id];
+                real_t c = local_comp[local_id] + local_comp[local_id + stride];
+                neumaier_add(&s, &c, local_sum[local_id + stride]);
+                local_sum[local_id] = s;
+                local_comp[local_id] = c;
+            } else {
+                local_sum[local_id] += local_sum[local_id + stride];
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (local_id == 0) {
+        output[get_group_id(0)] = (real2_t)(local_sum[0], local_comp[0]);
+    }
+}
+
+// One pass of the on-device reduction: every work-item folds a grid-strided
+// slice of the count input pairs, then each group reduces to one pair. The
+// host repeats the pass until a single pair is left.
+__kernel void final_sum_kernel(__global real2_t* input, long count, int compensated, __global real2_t* output, __local real_t* local_sum, __local real_t* local_comp) {
+    long global_size = get_global_size(0);
+    real_t sum = 0.0;
+    real_t comp = 0.0;
+
+    for (long i = get_global_id(0); i < count; i += global_size) {
+        real2_t value = input[i];
+        if (compensated) {
+            neumaier_add(&sum, &comp, value.x);
+            comp += value.y;
+        } else {
+            sum += value.x;
+        }
+    }
+
+    reduce_group(local_sum, local_comp, sum, comp, compensated, output);
+}
+
+// With --expr, user_integrand() replaces the per-point switch on func.
+eval_t integrand(eval_t x, int func) {
+#ifdef USER_INTEGRAND
+    return user_integrand(x);
+#else
+    switch (func) {
+        case 0: return EVAL_SIN(x);
+        case 1: return EVAL_COS(x);
+        case 2: return EVAL_EXP(x);
+        case 3: return EVAL_SQRT(x);
+        default: return EVAL_LOG(x);
+    }
+#endif
+}
+
+// Parametric integrands for sweeps: func applied to p * x, or the --expr
+// expression with its p bound to the parameter.
+eval_t param_integrand(eval_t x, eval_t p, int func) {
+#ifdef USER_INTEGRAND
+    return user_param_integrand(x, p);
+#else
+    return integrand(p * x, func);
+#endif
+}
+
+// Weight of point i in the composite rule, without the h/3, h or h/2 factor
+// that the host applies to the final sum.
+real_t rule_weight(long i, long n, int mode) {
+    int is_end = (i == 0 || i == n);
+    switch (mode) {
+        case 0: return is_end ? 1.0 : ((i & 1) ? 4.0 : 2.0);
+        case 1: return 1.0;
+        default: return is_end ? 1.0 : 2.0;
+    }
+}
+
+#ifdef VECTOR_WIDTH
+// Vector variant, built with -DVECTOR_WIDTH=2, 4, 8 or 16 when the device
+// prefers vectors of that width: each work-item evaluates VECTOR_WIDTH
+// consecutive points per grid-stride step. Blocks that contain an end point
+// or cross end fall back to the scalar weights.
+#define CONCAT_(a, b) a##b
+#define CONCAT(a, b) CONCAT_(a, b)
+typedef CONCAT(REAL_TYPE, VECTOR_WIDTH) realv_t;
+typedef CONCAT(EVAL_TYPE, VECTOR_WIDTH) evalv_t;
+#define VLOAD CONCAT(vload, VECTOR_WIDTH)
+#define VSTORE CONCAT(vstore, VECTOR_WIDTH)
+#define CONVERT_EVALV CONCAT(convert_, CONCAT(EVAL_TYPE, VECTOR_WIDTH))
+#define CONVERT_REALV CONCAT(convert_, CONCAT(REAL_TYPE, VECTOR_WIDTH))
+
+__constant real_t lane_offsets[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+// Interior Simpson weights from an even index; loading from offset 1 gives
+// the pattern for an odd first index.
+__constant real_t simpson_pattern[17] = { 2, 4, 2, 4, 2, 4, 2, 4, 2, 4, 2, 4, 2, 4, 2, 4, 2 };
+
+evalv_t integrand_vec(evalv_t x, int func) {
+#ifdef USER_INTEGRAND
+    eval_t lanes[VECTOR_WIDTH];
+    VSTORE(x, 0, lanes);
+    for (int l = 0; l < VECTOR_WIDTH; l++) {
+        lanes[l] = user_integrand(lanes[l]);
+    }
+    return VLOAD(0, lanes);
+#else
+    switch (func) {
+        case 0: return EVAL_SIN(x);
+        case 1: return EVAL_COS(x);
+        case 2: return EVAL_EXP(x);
+        case 3: return EVAL_SQRT(x);
+        default: return EVAL_LOG(x);
+    }
+#endif
+}
+
+// Lane-wise neumaier_add.
+void neumaier_add_vec(realv_t* sum, realv_t* comp, realv_t value) {
+    realv_t t = *sum + value;
+    *comp += select((value - t) + *sum, (*sum - t) + value, fabs(*sum) >= fabs(value));
+    *sum = t;
+}
+
+__kernel void fused_integral(real_t a, real_t h, long start, long end, long n, int mode, int func, int compensated, __global real2_t* output, __local real_t* local_sum, __local real_t* local_comp) {
+    long step = get_global_size(0) * VECTOR_WIDTH;
+    realv_t sum_v = 0;
+    realv_t comp_v = 0;
+    real_t sum = 0.0;
+    real_t comp = 0.0;
+
+    realv_t weight = (realv_t)(mode == 1 ? 1.0 : 2.0);
+    for (long base = start + get_global_id(0) * VECTOR_WIDTH; base < end; base += step) {
+        if (base > 0 && base + VECTOR_WIDTH <= end && base + VECTOR_WIDTH <= n) {
+            if (mode == 0) {
+                weight = VLOAD(0, simpson_pattern + (base & 1));
+            }
+            realv_t x = a + ((real_t)base + VLOAD(0, lane_offsets)) * h;
+            realv_t value = weight * CONVERT_REALV(integrand_vec(CONVERT_EVALV(x), func));
+            if (compensated) {
+                neumaier_add_vec(&sum_v, &comp_v, value);
+            } else {
+                sum_v += value;
+            }
+        } else {
+            for (long i = base; i < base + VECTOR_WIDTH && i < end; i++) {
+                real_t value = rule_weight(i, n, mode) * integrand((eval_t)(a + i * h), func);
+                if (compensated) {
+                    neumaier_add(&sum, &comp, value);
+                } else {
+                    sum += value;
+                }
+            }
+        }
+    }
+
+    real_t lane_sum[VECTOR_WIDTH];
+    real_t lane_comp[VECTOR_WIDTH];
+    VSTORE(sum_v, 0, lane_sum);
+    VSTORE(comp_v, 0, lane_comp);
+    for (int l = 0; l < VECTOR_WIDTH; l++) {
+        if (compensated) {
+            neumaier_add(&sum, &comp, lane_sum[l]);
+            comp += lane_comp[l];
+        } else {
+            sum += lane_sum[l];
+        }
+    }
+
+    reduce_group(local_sum, local_comp, sum, comp, compensated, output);
+}
+#else
+// Generates the points, evaluates the integrand, applies the rule weights and
+// reduces within the work-group in one launch. Each work-item walks the index
+// range [start, end) with a grid stride so the number of work-groups stays
+// bounded; the chunked path launches it once per slice of [0, n].
+__kernel void fused_integral(real_t a, real_t h, long start, long end, long n, int mode, int func, int compensated, __global real2_t* output, __local real_t* local_sum, __local real_t* local_comp) {
+    long global_size = get_global_size(0);
+    real_t sum = 0.0;
+    real_t comp = 0.0;
+
+    for (long i = start + get_global_id(0); i < end; i += global_size) {
+        real_t value = rule_weight(i, n, mode) * integrand((eval_t)(a + i * h), func);
+        if (compensated) {
+            neumaier_add(&sum, &comp, value);
+        } else {
+            sum += value;
+        }
+    }
+
+    reduce_group(local_sum, local_comp, sum, comp, compensated, output);
+}
+#endif
+
+// Tabulated samples instead of an integrand: samples[0] is point start of a
+// rule with n intervals, and the chunk holds the points [start, end).
+__kernel void sample_integral(__global const real_t* samples, long start, long end, long n, int mode, int compensated, __global real2_t* output, __local real_t* local_sum, __local real_t* local_comp) {
+    long global_size = get_global_size(0);
+    real_t sum = 0.0;
+    real_t comp = 0.0;
+
+    for (long i = get_global_id(0); i < end - start; i += global_size) {
+        real_t value = rule_weight(start + i, n, mode) * samples[i];
+        if (compensated) {
+            neumaier_add(&sum, &comp, value);
+        } else {
+            sum += value;
+        }
+    }
+
+    reduce_group(local_sum, local_comp, sum, comp, compensated, output);
+}
+
+#define MAX_DIM 32
+
+// Multi-dimensional test integrands over x[0..dim-1].
+real_t nd_integrand(real_t* x, int dim, int func) {
+    real_t acc = func == 2 ? 1.0 : 0.0;
+    for (int d = 0; d < dim; d++) {
+        switch (func) {
+            case 0: acc += x[d] * x[d]; break;
+            case 1: acc += x[d]; break;
+            case 2: acc *= x[d]; break;
+            default: break;
+        }
+    }
+
+    switch (func) {
+        case 0: return exp(-acc);
+        case 1: return sin(acc);
+        case 2: return cos(acc);
+        default: return 1.0;
+    }
+}
+
+// Tensor-product Simpson rule over a grid of total_points points. Each
+// work-item decomposes its 64-bit point index into private per-dimension
+// indices and multiplies the separable weights, which the host has already
+// scaled by h/3. The grid-stride loop and the group reduction keep memory
+// independent of the grid size.
+__kernel void simpson_kernel(__global real_t* lower, __global real_t* h, __global long* n, __global real_t* weights, __global long* weight_offsets, long total_points, int dim, int func, int compensated, __global real2_t* output, __local real_t* local_sum, __local real_t* local_comp) {
+    long global_size = get_global_size(0);
+    real_t sum = 0.0;
+    real_t comp = 0.0;
+    real_t x[MAX_DIM];
+
+    for (long p = get_global_id(0); p < total_points; p += global_size) {
+        long rest = p;
+        real_t coeff = 1.0;
+
+        for (int d = 0; d < dim; d++) {
+            long index = rest % (n[d] + 1);
+            rest /= n[d] + 1;
+            x[d] = lower[d] + index * h[d];
+            coeff *= weights[weight_offsets[d] + index];
+        }
+
+        real_t value = coeff * nd_integrand(x, dim, func);
+        if (compensated) {
+            neumaier_add(&sum, &comp, value);
+        } else {
+            sum += value;
+        }
+    }
+
+    reduce_group(local_sum, local_comp, sum, comp, compensated, output);
+}
+
+__constant uint halton_bases[MAX_DIM] = {
+    2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+    59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131
+};
+
+// SplitMix64 finalizer, used as a counter-based generator: hashing a
+// (seed, replicate, sample, dimension) key gives an independent stream per
+// work-item without any generator state.
+ulong mix64(ulong z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [0, 1) with as many random bits as real_t has mantissa bits.
+real_t uniform_real(ulong key) {
+#ifdef PRECISION_FP32
+    return (mix64(key) >> 40) * (1.0f / 16777216.0f);
+#else
+    return (mix64(key) >> 11) * (1.0 / 9007199254740992.0);
+#endif
+}
+
+real_t radical_inverse(ulong index, uint base) {
+    real_t inverse_base = 1.0 / base;
+    real_t scale = inverse_base;
+    real_t result = 0.0;
+    while (index > 0) {
+        result += (index % base) * scale;
+        index /= base;
+        scale *= inverse_base;
+    }
+    return result;
+}
+
+// Randomized quasi-Monte Carlo (sequence 0: Halton with a Cranley-Patterson
+// shift per replicate) or plain Monte Carlo (sequence 1: counter-based
+// uniforms). The second NDRange dimension selects the replicate, and every
+// replicate reduces into its own run of group partials.
+__kernel void qmc_kernel(__global real_t* lower, __global real_t* upper, long samples, int dim, int func, int sequence, ulong seed, int compensated, __global real2_t* output, __local real_t* local_sum, __local real_t* local_comp) {
+    ulong replicate = get_group_id(1);
+    ulong stream = mix64(seed ^ mix64(replicate + 1));
+    long global_size = get_global_size(0);
+    real_t sum = 0.0;
+    real_t comp = 0.0;
+    real_t x[MAX_DIM];
+
+    for (long i = get_global_id(0); i < samples; i += global_size) {
+        for (int d = 0; d < dim; d++) {
+            real_t u;
+            if (sequence == 0) {
+                u = radical_inverse(i + 1, halton_bases[d]) + uniform_real(stream + d);
+                u -= floor(u);
+            } else {
+                u = uniform_real(stream ^ mix64(((ulong)i << 6) | d));
+            }
+            x[d] = lower[d] + u * (upper[d] - lower[d]);
+        }
+
+        real_t value = nd_integrand(x, dim, func);
+        if (compensated) {
+            neumaier_add(&sum, &comp, value);
+        } else {
+            sum += value;
+        }
+    }
+
+    reduce_group(local_sum, local_comp, sum, comp, compensated, output + replicate * get_num_groups(0));
+}
+
+// 15-point Kronrod abscissae and weights on [-1, 1] (QUADPACK qk15). The
+// odd-indexed abscissae are the nodes of the embedded 7-point Gauss rule.
+__constant real_t kronrod_x[8] = {
+    0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+    0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+    0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+    0.207784955007898467600689403773245, 0.000000000000000000000000000000000
+};
+
+__constant real_t kronrod_w[8] = {
+    0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+    0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+    0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+    0.204432940075298892414161999234649, 0.209482141084727828012999174891714
+};
+
+__constant real_t gauss_w[4] = {
+    0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+    0.381830050505118944950369775488975, 0.417959183673469387755102040816327
+};
+
+// One subinterval per work-item: writes the Kronrod estimate and |K15 - G7|
+// as the local error estimate.
+__kernel void gauss_kronrod_kernel(__global real2_t* intervals, int count, int func, __global real2_t* results) {
+    int gid = get_global_id(0);
+    if (gid >= count) {
+        return;
+    }
+
+    real2_t interval = intervals[gid];
+    real_t center = 0.5 * (interval.x + interval.y);
+    real_t half_length = 0.5 * (interval.y - interval.x);
+
+    real_t f_center = integrand(center, func);
+    real_t kronrod = kronrod_w[7] * f_center;
+    real_t gauss = gauss_w[3] * f_center;
+
+    for (int j = 0; j < 7; j++) {
+        real_t dx = half_length * kronrod_x[j];
+        real_t f_sum = integrand(center - dx, func) + integrand(center + dx, func);
+        kronrod += kronrod_w[j] * f_sum;
+        if (j & 1) {
+            gauss += gauss_w[j / 2] * f_sum;
+        }
+    }
+
+    results[gid] = (real2_t)(kronrod * half_length, fabs((kronrod - gauss) * half_length));
+}
+
+// Composite Gauss-Legendre: panel p is [a + p * h, a + (p + 1) * h] and gets
+// the order-point rule whose nodes and weights on [-1, 1] the host computed
+// once. Work-items grid-stride over panels; the host applies the h / 2.
+__kernel void gauss_legendre_kernel(real_t a, real_t h, long panels, int order, int func, __constant real_t* nodes, __constant real_t* weights, int compensated, __global real2_t* output, __local real_t* local_sum, __local real_t* local_comp) {
+    long global_size = get_global_size(0);
+    real_t half_h = 0.5 * h;
+    real_t sum = 0.0;
+    real_t comp = 0.0;
+
+    for (long p = get_global_id(0); p < panels; p += global_size) {
+        real_t center = a + (p + 0.5) * h;
+        real_t panel = 0.0;
+        for (int j = 0; j < order; j++) {
+            panel += weights[j] * integrand((eval_t)(center + half_h * nodes[j]), func);
+        }
+        if (compensated) {
+            neumaier_add(&sum, &comp, panel);
+        } else {
+            sum += panel;
+        }
+    }
+
+    reduce_group(local_sum, local_comp, sum, comp, compensated, output);
+}
+
+// Tanh-sinh: x = c + d tanh(pi/2 sinh t) on [a, b] = [c - d, c + d]. Work-item
+// i takes t = offset + i * stride and its mirror -t (t = 0 only once). With
+// u = pi/2 sinh t, delta = 1 - tanh u is formed from exp(-2u) and the
+// abscissae are measured from the endpoints, so points next to a singular
+// end keep their precision; ones that round onto an endpoint are dropped.
+// The host applies the step size.
+__kernel void tanh_sinh_kernel(real_t a, real_t b, real_t offset, real_t stride, long count, int func, int compensated, __global real2_t* output, __local real_t* local_sum, __local real_t* local_comp) {
+    long global_size = get_global_size(0);
+    real_t half_pi = 1.57079632679489661923;
+    real_t d = 0.5 * (b - a);
+    real_t sum = 0.0;
+    real_t comp = 0.0;
+
+    for (long i = get_global_id(0); i < count; i += global_size) {
+        real_t t = offset + i * stride;
+        real_t e = exp(-2.0 * half_pi * sinh(t));
+        real_t delta = 2.0 * e / (1.0 + e);
+        real_t weight = d * half_pi * cosh(t) * delta * (2.0 - delta);
+        real_t left = a + d * delta;
+        real_t right = b - d * delta;
+
+        real_t value = 0.0;
+        if (left > a && left < b) {
+            value += integrand((eval_t)left, func);
+        }
+        if (t > 0.0 && right > a && right < b) {
+            value += integrand((eval_t)right, func);
+        }
+        value *= weight;
+
+        if (compensated) {
+            neumaier_add(&sum, &comp, value);
+        } else {
+            sum += value;
+        }
+    }
+
+    reduce_group(local_sum, local_comp, sum, comp, compensated, output);
+}
+
+// Many independent integrals in one NDRange. Job j owns the work-groups
+// [group_offsets[j], group_offsets[j + 1]); a group finds its job by binary
+// search, grid-strides over that job's points only and writes one partial
+// pair per group. segmented_sum_kernel then reduces each job's groups.
+__kernel void batch_integral(__global real_t* job_a, __global real_t* job_h, __global long* job_n, __global int* job_mode, __global int* job_func, __global int* group_offsets, int job_count, int compensated, __global real2_t* output, __local real_t* local_sum, __local real_t* local_comp) {
+    int group_id = get_group_id(0);
+    int lo = 0;
+    int hi = job_count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (group_offsets[mid] <= group_id) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    int job = lo;
+    real_t a = job_a[job];
+    real_t h = job_h[job];
+    long n = job_n[job];
+    int mode = job_mode[job];
+    int func = job_func[job];
+
+    long local_size = get_local_size(0);
+    long job_stride = (group_offsets[job + 1] - group_offsets[job]) * local_size;
+    real_t sum = 0.0;
+    real_t comp = 0.0;
+
+    for (long i = (group_id - group_offsets[job]) * local_size + get_local_id(0); i <= n; i += job_stride) {
+        real_t value = rule_weight(i, n, mode) * integrand((eval_t)(a + i * h), func);
+        if (compensated) {
+            neumaier_add(&sum, &comp, value);
+        } else {
+            sum += value;
+        }
+    }
+
+    reduce_group(local_sum, local_comp, sum, comp, compensated, output);
+}
+
+// Parameter sweep: the second NDRange dimension selects params[row] and the
+// groups along the first grid-stride over the n + 1 points of that row. Every
+// row reduces into its own run of group partials, as in qmc_kernel.
+__kernel void sweep_integral(real_t a, real_t h, long n, int mode, int func, __global const real_t* params, int compensated, __global real2_t* output, __local real_t* local_sum, __local real_t* local_comp) {
+    long row = get_group_id(1);
+    eval_t p = (eval_t)params[row];
+    long global_size = get_global_size(0);
+    real_t sum = 0.0;
+    real_t comp = 0.0;
+
+    for (long i = get_global_id(0); i <= n; i += global_size) {
+        real_t value = rule_weight(i, n, mode) * param_integrand((eval_t)(a + i * h), p, func);
+        if (compensated) {
+            neumaier_add(&sum, &comp, value);
+        } else {
+            sum += value;
+        }
+    }
+
+    reduce_group(local_sum, local_comp, sum, comp, compensated, output + row * get_num_groups(0));
+}
+
+// Work-group j reduces the partial pairs of job j to output[j].
+__kernel void segmented_sum_kernel(__global real2_t* input, __global int* group_offsets, int compensated, __global real2_t* output, __local real_t* local_sum, __local real_t* local_comp) {
+    int job = get_group_id(0);
+    int local_size = get_local_size(0);
+    real_t sum = 0.0;
+    real_t comp = 0.0;
+
+    for (int i = group_offsets[job] + get_local_id(0); i < group_offsets[job + 1]; i += local_size) {
+        real2_t value = input[i];
+        if (compensated) {
+            neumaier_add(&sum, &comp, value.x);
+            comp += value.y;
+        } else {
+            sum += value.x;
+        }
+    }
+
+    reduce_group(local_sum, local_comp, sum, comp, compensated, output);
+}
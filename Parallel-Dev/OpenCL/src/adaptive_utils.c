@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <CL/cl.h>
+#include "adaptive_utils.h"
+#include "opencl_utils.h"
+#include "input_utils.h"
+#include "time_utils.h"
+#include "trace_utils.h"
+
+// Adaptive Gauss-Kronrod quadrature. Every round evaluates all pending
+// subintervals in one launch (one work-item per subinterval). A subinterval
+// is accepted once its error estimate is within its share of the tolerance,
+// proportional to its length; otherwise it is bisected for the next round.
+// elapsed_time receives the wall time; returns 0, or -1 on failure.
+int run_adaptive(OpenCLEngine* engine, double a, double b, double tolerance, int func, double* final_result, double* exact_value, double* error, long long* evaluations, double* elapsed_time) {
+    cl_int ret;
+    cl_kernel gk_kernel = clCreateKernel(engine->program, "gauss_kronrod_kernel", &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create Gauss-Kronrod kernel. Error: %d\n", ret);
+        return -1;
+    }
+
+    // Bisection can at most double the pending count, so both interval lists
+    // hold twice the device capacity.
+    size_t capacity = 1024;
+    double *pending = (double *)malloc(2 * capacity * 2 * sizeof(double));
+    double *next = (double *)malloc(2 * capacity * 2 * sizeof(double));
+    double *results = (double *)malloc(capacity * 2 * sizeof(double));
+    cl_mem intervals_mem = clCreateBuffer(engine->context, CL_MEM_READ_ONLY, capacity * 2 * engine->real_size, NULL, &ret);
+    cl_mem results_mem = NULL;
+    if (ret == CL_SUCCESS) {
+        results_mem = clCreateBuffer(engine->context, CL_MEM_WRITE_ONLY, capacity * 2 * engine->real_size, NULL, &ret);
+    }
+    if (!pending || !next || !results || ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to allocate adaptive buffers.\n");
+        clReleaseKernel(gk_kernel);
+        release_mem(intervals_mem);
+        release_mem(results_mem);
+        free(pending);
+        free(next);
+        free(results);
+        return -1;
+    }
+
+    pending[0] = a;
+    pending[1] = b;
+    size_t count = 1;
+
+    double width = fabs(b - a);
+    double total = 0.0;
+    double comp = 0.0;
+    int forced = 0;
+    int status = 0;
+    *evaluations = 0;
+
+    struct timespec start_t, end_t;
+    clock_gettime(CLOCK_MONOTONIC, &start_t);
+
+    for (int round = 0; status == 0 && count > 0; round++) {
+        if (count > capacity) {
+            while (capacity < count) {
+                capacity *= 2;
+            }
+            // Each list is replaced only once its realloc succeeded, so the
+            // cleanup below frees whatever is held on failure.
+            double *grown = (double *)realloc(pending, 2 * capacity * 2 * sizeof(double));
+            if (grown != NULL) {
+                pending = grown;
+                grown = (double *)realloc(next, 2 * capacity * 2 * sizeof(double));
+            }
+            if (grown != NULL) {
+                next = grown;
+                grown = (double *)realloc(results, capacity * 2 * sizeof(double));
+            }
+            if (grown == NULL) {
+                fprintf(stderr, "Failed to grow adaptive buffers to %zu intervals.\n", capacity);
+                status = -1;
+                break;
+            }
+            results = grown;
+
+            release_mem(intervals_mem);
+            release_mem(results_mem);
+            results_mem = NULL;
+            intervals_mem = clCreateBuffer(engine->context, CL_MEM_READ_ONLY, capacity * 2 * engine->real_size, NULL, &ret);
+            if (ret == CL_SUCCESS) {
+                results_mem = clCreateBuffer(engine->context, CL_MEM_WRITE_ONLY, capacity * 2 * engine->real_size, NULL, &ret);
+            }
+            if (ret != CL_SUCCESS) {
+                fprintf(stderr, "Failed to grow adaptive device buffers to %zu intervals. Error: %d\n", capacity, ret);
+                status = -1;
+                break;
+            }
+        }
+
+        int interval_count = (int)count;
+        cl_event write_event, gk_event, read_event;
+        ret = write_real_buffer(engine, engine->command_queue, intervals_mem, pending, count * 2, trace_slot(&write_event));
+        ret |= clSetKernelArg(gk_kernel, 0, sizeof(cl_mem), (void *)&intervals_mem);
+        ret |= clSetKernelArg(gk_kernel, 1, sizeof(int), (void *)&interval_count);
+        ret |= clSetKernelArg(gk_kernel, 2, sizeof(int), (void *)&func);
+        ret |= clSetKernelArg(gk_kernel, 3, sizeof(cl_mem), (void *)&results_mem);
+
+        size_t local_item_size = engine->local_size;
+        size_t global_item_size = (count + local_item_size - 1) / local_item_size * local_item_size;
+        ret |= clEnqueueNDRangeKernel(engine->command_queue, gk_kernel, 1, NULL, &global_item_size, &local_item_size, 0, NULL, trace_slot(&gk_event));
+        ret |= clEnqueueReadBuffer(engine->command_queue, results_mem, CL_TRUE, 0, count * 2 * engine->real_size, results, 0, NULL, trace_slot(&read_event));
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to run adaptive round %d. Error: %d\n", round, ret);
+            clFinish(engine->command_queue);
+            status = -1;
+            break;
+        }
+        trace_collect("write intervals", &write_event);
+        trace_collect("gauss_kronrod_kernel", &gk_event);
+        trace_collect("read results", &read_event);
+        widen_reals(engine, results, count * 2);
+
+        *evaluations += (long long)count * KRONROD_POINTS;
+
+        double trace_start = trace_now();
+        size_t next_count = 0;
+        for (size_t i = 0; i < count; i++) {
+            double lo = pending[2 * i];
+            double hi = pending[2 * i + 1];
+            double local_tolerance = width > 0.0 ? tolerance * fabs(hi - lo) / width : tolerance;
+
+            int converged = results[2 * i + 1] <= local_tolerance;
+            int exhausted = round == MAX_ROUNDS - 1 || next_count + 2 > MAX_INTERVALS;
+            if (converged || exhausted) {
+                neumaier_add(&total, &comp, results[2 * i]);
+                forced |= !converged;
+            } else {
+                double mid = 0.5 * (lo + hi);
+                next[2 * next_count] = lo;
+                next[2 * next_count + 1] = mid;
+                next[2 * next_count + 2] = mid;
+                next[2 * next_count + 3] = hi;
+                next_count += 2;
+            }
+        }
+
+        trace_host("refine intervals", trace_start);
+
+        double *swap = pending;
+        pending = next;
+        next = swap;
+        count = next_count;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end_t);
+
+    if (forced && status == 0) {
+        fprintf(stderr, "Warning: tolerance %.3e not reached on every subinterval.\n", tolerance);
+    }
+
+    *final_result = total + comp;
+    *exact_value = exact_integral(a, b, func);
+    *error = fabs(*final_result - *exact_value);
+
+    clReleaseKernel(gk_kernel);
+    release_mem(intervals_mem);
+    release_mem(results_mem);
+    free(pending);
+    free(next);
+    free(results);
+
+    *elapsed_time = get_elapsed_time(start_t, end_t);
+    return status;
+}
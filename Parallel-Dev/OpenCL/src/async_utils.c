@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <CL/cl.h>
+#include "async_utils.h"
+#include "opencl_utils.h"
+#include "input_utils.h"
+#include "trace_utils.h"
+
+static cl_mem chain_buffer(IntegralFuture* future, size_t pairs) {
+    cl_int ret;
+    if (future->buffer_count == MAX_CHAIN) {
+        fprintf(stderr, "Reduction chain longer than %d launches.\n", MAX_CHAIN);
+        return NULL;
+    }
+    cl_mem mem = clCreateBuffer(future->engine->context, CL_MEM_READ_WRITE, pairs * 2 * future->engine->real_size, NULL, &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create partial sum buffer. Error: %d\n", ret);
+        return NULL;
+    }
+    future->buffers[future->buffer_count++] = mem;
+    return mem;
+}
+
+// Releases everything the future holds, also when it was only partly built.
+static void release_future(IntegralFuture* future) {
+    for (int i = 0; i < future->event_count; i++) {
+        clReleaseEvent(future->events[i]);
+    }
+    if (future->read_event != NULL) {
+        clReleaseEvent(future->read_event);
+    }
+    for (int i = 0; i < future->buffer_count; i++) {
+        clReleaseMemObject(future->buffers[i]);
+    }
+    if (future->fused_kernel != NULL) {
+        clReleaseKernel(future->fused_kernel);
+    }
+    if (future->final_sum_kernel != NULL) {
+        clReleaseKernel(future->final_sum_kernel);
+    }
+    pthread_cond_destroy(&future->done);
+    pthread_mutex_destroy(&future->lock);
+    free(future);
+}
+
+// A chain that failed to enqueue may still have commands in flight that
+// write into its buffers or its pair; drain the queue before releasing it.
+static IntegralFuture* abandon_future(IntegralFuture* future) {
+    clFinish(future->engine->async_queue);
+    release_future(future);
+    return NULL;
+}
+
+// Runs on a runtime thread once the final pair has been read back.
+static void CL_CALLBACK read_complete(cl_event event, cl_int status, void* user_data) {
+    IntegralFuture* future = (IntegralFuture*)user_data;
+    if (status == CL_COMPLETE) {
+        widen_reals(future->engine, future->pair, 2);
+    }
+    pthread_mutex_lock(&future->lock);
+    future->status = status;
+    pthread_mutex_unlock(&future->lock);
+    if (future->callback != NULL) {
+        future->callback(future, future->user_data);
+    }
+    pthread_mutex_lock(&future->lock);
+    future->complete = 1;
+    pthread_cond_signal(&future->done);
+    pthread_mutex_unlock(&future->lock);    // last access: the future may be freed after this
+}
+
+// Enqueues the fused kernel over [start, end), as many final_sum passes as
+// the partial count needs (known up front, so nothing waits on the host) and
+// the read of the last pair. Each command waits only on its predecessor.
+// Returns NULL if any of it cannot be enqueued.
+IntegralFuture* range_sum_async(OpenCLEngine* engine, double a, double h, long long start, long long end, long long size, int mode, int func, FutureCallback callback, void* user_data) {
+    cl_int ret;
+    double trace_start = trace_now();
+    IntegralFuture* future = (IntegralFuture*)calloc(1, sizeof(IntegralFuture));
+    if (future == NULL) {
+        fprintf(stderr, "Failed to allocate future.\n");
+        return NULL;
+    }
+    future->engine = engine;
+    future->factor = 1.0;
+    future->callback = callback;
+    future->user_data = user_data;
+    pthread_mutex_init(&future->lock, NULL);
+    pthread_cond_init(&future->done, NULL);
+
+    future->fused_kernel = clCreateKernel(engine->program, "fused_integral", &ret);
+    if (ret == CL_SUCCESS) {
+        future->final_sum_kernel = clCreateKernel(engine->program, "final_sum_kernel", &ret);
+    }
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create integration kernels. Error: %d\n", ret);
+        release_future(future);
+        return NULL;
+    }
+
+    size_t local_item_size = engine->local_size;
+    size_t global_item_size = fused_global_size(engine, end - start);
+    size_t count = global_item_size / local_item_size;
+    cl_mem input_mem = chain_buffer(future, count);
+    if (input_mem == NULL || set_fused_args(engine, future->fused_kernel, a, h, start, end, size, mode, func, engine->compensated, input_mem, local_item_size) != 0) {
+        release_future(future);
+        return NULL;
+    }
+
+    ret = clEnqueueNDRangeKernel(engine->async_queue, future->fused_kernel, 1, NULL, &global_item_size, &local_item_size, 0, NULL, &future->events[future->event_count]);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to enqueue fused kernel. Error: %d\n", ret);
+        release_future(future);
+        return NULL;
+    }
+    future->event_count++;
+
+    while (count > 1) {
+        size_t num_work_groups = (count + local_item_size * REDUCE_ITEMS_PER_THREAD - 1) / (local_item_size * REDUCE_ITEMS_PER_THREAD);
+        size_t reduce_item_size = num_work_groups * local_item_size;
+        cl_long input_count = (cl_long)count;
+        cl_mem output_mem = chain_buffer(future, num_work_groups);
+        if (output_mem == NULL) {
+            return abandon_future(future);
+        }
+
+        ret = clSetKernelArg(future->final_sum_kernel, 0, sizeof(cl_mem), (void *)&input_mem);
+        ret |= clSetKernelArg(future->final_sum_kernel, 1, sizeof(cl_long), (void *)&input_count);
+        ret |= clSetKernelArg(future->final_sum_kernel, 2, sizeof(int), (void *)&engine->compensated);
+        ret |= clSetKernelArg(future->final_sum_kernel, 3, sizeof(cl_mem), (void *)&output_mem);
+        ret |= clSetKernelArg(future->final_sum_kernel, 4, local_item_size * engine->real_size, NULL);
+        ret |= clSetKernelArg(future->final_sum_kernel, 5, local_item_size * engine->real_size, NULL);
+        if (ret == CL_SUCCESS) {
+            ret = clEnqueueNDRangeKernel(engine->async_queue, future->final_sum_kernel, 1, NULL, &reduce_item_size, &local_item_size,
+                                         1, &future->events[future->event_count - 1], &future->events[future->event_count]);
+        }
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to enqueue reduction pass. Error: %d\n", ret);
+            return abandon_future(future);
+        }
+        future->event_count++;
+
+        input_mem = output_mem;
+        count = num_work_groups;
+    }
+
+    ret = clEnqueueReadBuffer(engine->async_queue, input_mem, CL_FALSE, 0, 2 * engine->real_size, future->pair,
+                              1, &future->events[future->event_count - 1], &future->read_event);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to enqueue result read. Error: %d\n", ret);
+        future->read_event = NULL;
+        return abandon_future(future);
+    }
+    ret = clSetEventCallback(future->read_event, CL_COMPLETE, read_complete, future);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to register result callback. Error: %d\n", ret);
+        return abandon_future(future);
+    }
+    clFlush(engine->async_queue);
+    trace_host("enqueue integration", trace_start);
+
+    return future;
+}
+
+IntegralFuture* integrate_async(OpenCLEngine* engine, double a, double b, long long size, int mode, int func, FutureCallback callback, void* user_data) {
+    if (mode < 0 || mode > 2) {
+        fprintf(stderr, "Invalid mode selected.\n");
+        return NULL;
+    }
+
+    double h = (b - a) / size;
+    IntegralFuture* future = range_sum_async(engine, a, h, 0, size + 1, size, mode, func, callback, user_data);
+    if (future != NULL) {
+        future->factor = rule_factor(mode, h);
+    }
+    return future;
+}
+
+int future_ready(IntegralFuture* future) {
+    pthread_mutex_lock(&future->lock);
+    int complete = future->complete;
+    pthread_mutex_unlock(&future->lock);
+    return complete;
+}
+
+// Waits for the chain, releases it and frees the future. On success result
+// receives the integral and kernel_time (if not NULL) the device time of all
+// launches in the chain; returns 0, or -1 if any command in the chain failed.
+int future_get(IntegralFuture* future, double* result, double* kernel_time) {
+    double trace_start = trace_now();
+    clWaitForEvents(1, &future->read_event);
+
+    // The read is done, but its callback may still be running on the
+    // runtime thread; wait until it lets go of the future.
+    pthread_mutex_lock(&future->lock);
+    while (!future->complete) {
+        pthread_cond_wait(&future->done, &future->lock);
+    }
+    cl_int status = future->status;
+    pthread_mutex_unlock(&future->lock);
+    trace_host("wait for result", trace_start);
+
+    if (status == CL_COMPLETE) {
+        for (int i = 0; i < future->event_count; i++) {
+            trace_command(i == 0 ? "fused_integral" : "final_sum_kernel", future->events[i]);
+        }
+        trace_command("read result", future->read_event);
+
+        if (kernel_time != NULL) {
+            *kernel_time = 0.0;
+            for (int i = 0; i < future->event_count; i++) {
+                *kernel_time += event_seconds(future->events[i]);
+            }
+        }
+        *result = future->factor * (future->pair[0] + future->pair[1]);
+    } else {
+        fprintf(stderr, "Integration failed on the device. Error: %d\n", status);
+    }
+
+    release_future(future);
+    return status == CL_COMPLETE ? 0 : -1;
+}
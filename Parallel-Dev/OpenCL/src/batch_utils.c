@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <CL/cl.h>
+#include "batch_utils.h"
+#include "opencl_utils.h"
+#include "input_utils.h"
+#include "trace_utils.h"
+
+cl_mem create_job_buffer(OpenCLEngine* engine, size_t size, void* data) {
+    cl_int ret;
+    cl_mem mem = clCreateBuffer(engine->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, size, data, &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create batch buffer. Error: %d\n", ret);
+        return NULL;
+    }
+    return mem;
+}
+
+// job_a and job_h go to the device as real_t.
+static cl_mem create_real_job_buffer(OpenCLEngine* engine, const double* values, int count) {
+    cl_int ret;
+    cl_mem mem = create_real_buffer(engine, values, count, &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create batch buffer. Error: %d\n", ret);
+        return NULL;
+    }
+    return mem;
+}
+
+// Device side of one batch: buffers, the two launches and the read of every
+// job's pair. Returns 0, or -1 with everything it created released.
+static int enqueue_batch(OpenCLEngine* engine, int count, double* job_a, double* job_h, cl_long* job_n, int* job_mode, int* job_func, int* group_offsets, double* pairs, double* elapsed_time) {
+    cl_int ret;
+    cl_kernel batch_kernel = clCreateKernel(engine->program, "batch_integral", &ret);
+    cl_kernel segmented_kernel = NULL;
+    if (ret == CL_SUCCESS) {
+        segmented_kernel = clCreateKernel(engine->program, "segmented_sum_kernel", &ret);
+    }
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create batch kernels. Error: %d\n", ret);
+        if (batch_kernel != NULL) {
+            clReleaseKernel(batch_kernel);
+        }
+        return -1;
+    }
+
+    int status = -1;
+    size_t total_groups = group_offsets[count];
+    double trace_start = trace_now();
+    cl_mem a_mem = create_real_job_buffer(engine, job_a, count);
+    cl_mem h_mem = create_real_job_buffer(engine, job_h, count);
+    cl_mem n_mem = create_job_buffer(engine, count * sizeof(cl_long), job_n);
+    cl_mem mode_mem = create_job_buffer(engine, count * sizeof(int), job_mode);
+    cl_mem func_mem = create_job_buffer(engine, count * sizeof(int), job_func);
+    cl_mem offsets_mem = create_job_buffer(engine, (count + 1) * sizeof(int), group_offsets);
+    cl_int partial_ret, sums_ret;
+    cl_mem partial_sums_mem = clCreateBuffer(engine->context, CL_MEM_READ_WRITE, total_groups * 2 * engine->real_size, NULL, &partial_ret);
+    cl_mem job_sums_mem = clCreateBuffer(engine->context, CL_MEM_WRITE_ONLY, count * 2 * engine->real_size, NULL, &sums_ret);
+    trace_host("create buffers", trace_start);
+
+    if (!a_mem || !h_mem || !n_mem || !mode_mem || !func_mem || !offsets_mem) {
+        // create_job_buffer has reported the failure
+    } else if (partial_ret != CL_SUCCESS || sums_ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create batch result buffers. Error: %d\n", partial_ret != CL_SUCCESS ? partial_ret : sums_ret);
+    } else {
+        size_t local_item_size = engine->local_size;
+        ret = clSetKernelArg(batch_kernel, 0, sizeof(cl_mem), (void *)&a_mem);
+        ret |= clSetKernelArg(batch_kernel, 1, sizeof(cl_mem), (void *)&h_mem);
+        ret |= clSetKernelArg(batch_kernel, 2, sizeof(cl_mem), (void *)&n_mem);
+        ret |= clSetKernelArg(batch_kernel, 3, sizeof(cl_mem), (void *)&mode_mem);
+        ret |= clSetKernelArg(batch_kernel, 4, sizeof(cl_mem), (void *)&func_mem);
+        ret |= clSetKernelArg(batch_kernel, 5, sizeof(cl_mem), (void *)&offsets_mem);
+        ret |= clSetKernelArg(batch_kernel, 6, sizeof(int), (void *)&count);
+        ret |= clSetKernelArg(batch_kernel, 7, sizeof(int), (void *)&engine->compensated);
+        ret |= clSetKernelArg(batch_kernel, 8, sizeof(cl_mem), (void *)&partial_sums_mem);
+        ret |= clSetKernelArg(batch_kernel, 9, local_item_size * engine->real_size, NULL);
+        ret |= clSetKernelArg(batch_kernel, 10, local_item_size * engine->real_size, NULL);
+
+        ret |= clSetKernelArg(segmented_kernel, 0, sizeof(cl_mem), (void *)&partial_sums_mem);
+        ret |= clSetKernelArg(segmented_kernel, 1, sizeof(cl_mem), (void *)&offsets_mem);
+        ret |= clSetKernelArg(segmented_kernel, 2, sizeof(int), (void *)&engine->compensated);
+        ret |= clSetKernelArg(segmented_kernel, 3, sizeof(cl_mem), (void *)&job_sums_mem);
+        ret |= clSetKernelArg(segmented_kernel, 4, local_item_size * engine->real_size, NULL);
+        ret |= clSetKernelArg(segmented_kernel, 5, local_item_size * engine->real_size, NULL);
+
+        cl_event batch_event = NULL, segmented_event = NULL, read_event;
+        size_t batch_item_size = total_groups * local_item_size;
+        size_t segmented_item_size = (size_t)count * local_item_size;
+
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to set batch kernel arguments. Error: %d\n", ret);
+        } else {
+            ret = clEnqueueNDRangeKernel(engine->command_queue, batch_kernel, 1, NULL, &batch_item_size, &local_item_size, 0, NULL, &batch_event);
+            if (ret == CL_SUCCESS) {
+                ret = clEnqueueNDRangeKernel(engine->command_queue, segmented_kernel, 1, NULL, &segmented_item_size, &local_item_size, 0, NULL, &segmented_event);
+            }
+            if (ret == CL_SUCCESS) {
+                ret = clEnqueueReadBuffer(engine->command_queue, job_sums_mem, CL_TRUE, 0, count * 2 * engine->real_size, pairs, 0, NULL, trace_slot(&read_event));
+            }
+            if (ret != CL_SUCCESS) {
+                fprintf(stderr, "Failed to run batch. Error: %d\n", ret);
+                clFinish(engine->command_queue);
+            } else {
+                trace_command("batch_integral", batch_event);
+                trace_command("segmented_sum_kernel", segmented_event);
+                trace_collect("read results", &read_event);
+                widen_reals(engine, pairs, 2 * (size_t)count);
+                *elapsed_time = event_seconds(batch_event) + event_seconds(segmented_event);
+                status = 0;
+            }
+        }
+        if (batch_event != NULL) {
+            clReleaseEvent(batch_event);
+        }
+        if (segmented_event != NULL) {
+            clReleaseEvent(segmented_event);
+        }
+    }
+
+    clReleaseKernel(batch_kernel);
+    clReleaseKernel(segmented_kernel);
+    release_mem(a_mem);
+    release_mem(h_mem);
+    release_mem(n_mem);
+    release_mem(mode_mem);
+    release_mem(func_mem);
+    release_mem(offsets_mem);
+    release_mem(partial_sums_mem);
+    release_mem(job_sums_mem);
+    return status;
+}
+
+// Runs every job of the batch with one integration launch and one segmented
+// reduction launch, then reads all results back at once. Each job gets work-
+// groups in proportion to its point count, capped at MAX_GROUPS_PER_JOB.
+// Returns 0, or -1 on an invalid job or a device failure; elapsed_time
+// receives the kernel time.
+int run_batch(OpenCLEngine* engine, const Params* params, int count, double* results, double* elapsed_time) {
+    for (int j = 0; j < count; j++) {
+        if (params[j].mode < 0 || params[j].mode > 2 || params[j].n <= 0) {
+            fprintf(stderr, "Invalid job %d in batch.\n", j);
+            return -1;
+        }
+    }
+
+    double *job_a = (double *)malloc(count * sizeof(double));
+    double *job_h = (double *)malloc(count * sizeof(double));
+    cl_long *job_n = (cl_long *)malloc(count * sizeof(cl_long));
+    int *job_mode = (int *)malloc(count * sizeof(int));
+    int *job_func = (int *)malloc(count * sizeof(int));
+    int *group_offsets = (int *)malloc((count + 1) * sizeof(int));
+    double *pairs = (double *)malloc(count * 2 * sizeof(double));
+    int status = -1;
+
+    if (!job_a || !job_h || !job_n || !job_mode || !job_func || !group_offsets || !pairs) {
+        fprintf(stderr, "Failed to allocate batch of %d jobs.\n", count);
+    } else {
+        group_offsets[0] = 0;
+        for (int j = 0; j < count; j++) {
+            job_a[j] = params[j].a;
+            job_h[j] = (params[j].b - params[j].a) / params[j].n;
+            job_n[j] = params[j].n;
+            job_mode[j] = params[j].mode;
+            job_func[j] = params[j].func;
+
+            long long groups = (params[j].n + engine->local_size) / engine->local_size;
+            if (groups > MAX_GROUPS_PER_JOB) {
+                groups = MAX_GROUPS_PER_JOB;
+            }
+            group_offsets[j + 1] = group_offsets[j] + (int)groups;
+        }
+
+        status = enqueue_batch(engine, count, job_a, job_h, job_n, job_mode, job_func, group_offsets, pairs, elapsed_time);
+        if (status == 0) {
+            for (int j = 0; j < count; j++) {
+                results[j] = rule_factor(job_mode[j], job_h[j]) * (pairs[2 * j] + pairs[2 * j + 1]);
+            }
+        }
+    }
+
+    free(job_a);
+    free(job_h);
+    free(job_n);
+    free(job_mode);
+    free(job_func);
+    free(group_offsets);
+    free(pairs);
+
+    return status;
+}
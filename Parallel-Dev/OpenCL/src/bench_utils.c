@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "bench_utils.h"
+#include "opencl_utils.h"
+#include "cpu_utils.h"
+#include "input_utils.h"
+#include "time_utils.h"
+#include "dispatch_utils.h"
+
+static int parse_int_list(char *tokens, int *values, int max_values) {
+    int count = 0;
+    for (char *token = strtok(tokens, " \t\r\n"); token != NULL && count < max_values; token = strtok(NULL, " \t\r\n")) {
+        values[count++] = atoi(token);
+    }
+    return count;
+}
+
+// Spec format, one key per line ('#' starts a comment):
+//   backends opencl cpu auto
+//   precisions fp64 mixed fp32   (OpenCL only)
+//   modes 0 1 2
+//   funcs 0
+//   n <start> <stop> <factor>
+//   a 2
+//   b 10
+//   warmup 2
+//   repeat 10
+//   format csv|json
+int read_bench_spec(const char *filename, BenchSpec *spec) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "File couldn't be opened: %s\n", filename);
+        return -1;
+    }
+
+    BenchSpec defaults = { { BACKEND_OPENCL }, 1, { 0 }, 1, { 0 }, 1, 10, 1000000, 10, 2.0, 10.0, 2, 10, BENCH_CSV, { PRECISION_FP64 }, 0 };
+    *spec = defaults;
+
+    char line[512];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+
+        char *key = strtok(line, " \t\r\n");
+        if (key == NULL) {
+            continue;
+        }
+        char *rest = strtok(NULL, "");
+        if (rest == NULL) {
+            rest = line + strlen(line);
+        }
+
+        if (strcmp(key, "backends") == 0) {
+            spec->backend_count = 0;
+            for (char *token = strtok(rest, " \t\r\n"); token != NULL && spec->backend_count < MAX_BENCH_VALUES; token = strtok(NULL, " \t\r\n")) {
+                int backend = parse_backend(token);
+                if (backend < 0) {
+                    fprintf(stderr, "Unknown backend in bench spec: %s\n", token);
+                    fclose(file);
+                    return -1;
+                }
+                spec->backends[spec->backend_count++] = backend;
+            }
+        } else if (strcmp(key, "precisions") == 0) {
+            spec->precision_count = 0;
+            for (char *token = strtok(rest, " \t\r\n"); token != NULL && spec->precision_count < MAX_BENCH_VALUES; token = strtok(NULL, " \t\r\n")) {
+                int precision = parse_precision(token);
+                if (precision < 0) {
+                    fprintf(stderr, "Unknown precision in bench spec: %s\n", token);
+                    fclose(file);
+                    return -1;
+                }
+                spec->precisions[spec->precision_count++] = precision;
+            }
+        } else if (strcmp(key, "modes") == 0) {
+            spec->mode_count = parse_int_list(rest, spec->modes, MAX_BENCH_VALUES);
+        } else if (strcmp(key, "funcs") == 0) {
+            spec->func_count = parse_int_list(rest, spec->funcs, MAX_BENCH_VALUES);
+        } else if (strcmp(key, "n") == 0) {
+            if (sscanf(rest, "%lld %lld %lld", &spec->n_start, &spec->n_stop, &spec->n_factor) != 3 || spec->n_start <= 0 || spec->n_factor < 2) {
+                fprintf(stderr, "Bench spec needs 'n <start> <stop> <factor>' with factor >= 2.\n");
+                fclose(file);
+                return -1;
+            }
+        } else if (strcmp(key, "a") == 0) {
+            spec->a = atof(rest);
+        } else if (strcmp(key, "b") == 0) {
+            spec->b = atof(rest);
+        } else if (strcmp(key, "warmup") == 0) {
+            spec->warmup = atoi(rest);
+        } else if (strcmp(key, "repeat") == 0) {
+            spec->repeat = atoi(rest);
+        } else if (strcmp(key, "format") == 0) {
+            spec->format = strncmp(rest, "json", 4) == 0 ? BENCH_JSON : BENCH_CSV;
+        } else {
+            fprintf(stderr, "Unknown key in bench spec: %s\n", key);
+            fclose(file);
+            return -1;
+        }
+    }
+
+    fclose(file);
+
+    if (spec->repeat < 1 || spec->warmup < 0) {
+        fprintf(stderr, "Bench spec needs repeat >= 1 and warmup >= 0.\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int compare_doubles(const void *left, const void *right) {
+    double l = *(const double *)left;
+    double r = *(const double *)right;
+    return (l > r) - (l < r);
+}
+
+// Median, nearest-rank 95th percentile and sample standard deviation.
+void summarize_samples(double *samples, int count, BenchStats *stats) {
+    qsort(samples, count, sizeof(double), compare_doubles);
+
+    stats->median = (count % 2 == 1) ? samples[count / 2] : 0.5 * (samples[count / 2 - 1] + samples[count / 2]);
+
+    int rank = (int)ceil(0.95 * count);
+    stats->p95 = samples[(rank > 0 ? rank : 1) - 1];
+
+    double mean = 0.0;
+    for (int i = 0; i < count; i++) {
+        mean += samples[i];
+    }
+    mean /= count;
+
+    double variance = 0.0;
+    for (int i = 0; i < count; i++) {
+        variance += (samples[i] - mean) * (samples[i] - mean);
+    }
+    stats->stddev = count > 1 ? sqrt(variance / (count - 1)) : 0.0;
+}
+
+static void print_json_string(FILE *out, const char *text) {
+    fputc('"', out);
+    for (const char *c = text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', out);
+        }
+        if ((unsigned char)*c >= 0x20) {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+// One sample: the kernel-only time reported by the backend, and the wall time
+// of the whole request. For OpenCL that includes platform and device query,
+// program load or build, buffer setup, transfers and teardown. Returns -1 if
+// the OpenCL backend fails; auto falls back to the CPU if OpenCL cannot start.
+double measure_once(int backend, const Options *options, double a, double b, long long n, int mode, int func, double *kernel_time, double *result) {
+    struct timespec start_t, end_t;
+    clock_gettime(CLOCK_MONOTONIC, &start_t);
+
+    int automatic = backend == BACKEND_AUTO;
+    if (automatic) {
+        backend = resolve_backend(options, 1, n + 1);
+    }
+
+    OpenCLEngine engine;
+    if (backend == BACKEND_OPENCL && engine_init_options(&engine, KERNEL_FILE, options) != 0) {
+        if (!automatic) {
+            return -1.0;
+        }
+        backend = BACKEND_CPU;
+    }
+
+    if (backend == BACKEND_OPENCL) {
+        double exact_value, error;
+        int status = run_algorithm(&engine, a, b, n, mode, func, result, &exact_value, &error, kernel_time);
+        engine_destroy(&engine);
+        if (status != 0) {
+            return -1.0;
+        }
+    } else {
+        struct timespec kernel_start, kernel_end;
+        clock_gettime(CLOCK_MONOTONIC, &kernel_start);
+        *result = calculate_integral((b - a) / n, n, mode, func, a, b, NULL);
+        clock_gettime(CLOCK_MONOTONIC, &kernel_end);
+        *kernel_time = get_elapsed_time(kernel_start, kernel_end);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end_t);
+    return get_elapsed_time(start_t, end_t);
+}
+
+int run_bench(const BenchSpec *spec, const Options *options, FILE *out) {
+    char device[512] = "none";
+    for (int i = 0; i < spec->backend_count; i++) {
+        if (spec->backends[i] != BACKEND_CPU) {
+            OpenCLEngine engine;
+            if (engine_init_options(&engine, KERNEL_FILE, options) == 0) {
+                get_device_description(&engine, device, sizeof(device));
+                engine_destroy(&engine);
+            }
+            break;
+        }
+    }
+    long host_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    double *kernel_samples = (double *)malloc(spec->repeat * sizeof(double));
+    double *wall_samples = (double *)malloc(spec->repeat * sizeof(double));
+    if (!kernel_samples || !wall_samples) {
+        fprintf(stderr, "Failed to allocate benchmark samples.\n");
+        free(kernel_samples);
+        free(wall_samples);
+        return -1;
+    }
+
+    if (spec->format == BENCH_JSON) {
+        fprintf(out, "{\n  \"device\": ");
+        print_json_string(out, device);
+        fprintf(out, ",\n  \"host_threads\": %ld,\n  \"warmup\": %d,\n  \"repeat\": %d,\n  \"results\": [", host_threads, spec->warmup, spec->repeat);
+    } else {
+        fprintf(out, "# device: %s\n# host_threads: %ld\n# warmup: %d repeat: %d\n", device, host_threads, spec->warmup, spec->repeat);
+        fprintf(out, "backend,precision,mode,func,a,b,n,kernel_median,kernel_p95,kernel_stddev,wall_median,wall_p95,wall_stddev,result,error\n");
+    }
+
+    // A failed measurement ends the sweep; the rows so far are still written
+    // out as a complete document.
+    int status = 0;
+    int rows = 0;
+    for (int bi = 0; bi < spec->backend_count && status == 0; bi++) {
+        int backend = spec->backends[bi];
+        const char *backend_name = backend == BACKEND_OPENCL ? "opencl" : (backend == BACKEND_CPU ? "cpu" : "auto");
+        int precision_count = spec->precision_count > 0 ? spec->precision_count : 1;
+
+        for (int pi = 0; pi < precision_count && status == 0; pi++) {
+            // The CPU backend has a single (double) variant.
+            if (backend == BACKEND_CPU && pi > 0) {
+                break;
+            }
+            Options variant = *options;
+            if (spec->precision_count > 0 && backend != BACKEND_CPU) {
+                variant.precision = spec->precisions[pi];
+            }
+            const char *variant_name = backend == BACKEND_CPU ? "fp64" : precision_name(variant.precision);
+
+            for (int mi = 0; mi < spec->mode_count && status == 0; mi++) {
+                for (int fi = 0; fi < spec->func_count && status == 0; fi++) {
+                    for (long long n = spec->n_start; n <= spec->n_stop; n *= spec->n_factor) {
+                        int mode = spec->modes[mi];
+                        int func = spec->funcs[fi];
+                        double result = 0.0;
+
+                        for (int run = 0; run < spec->warmup + spec->repeat; run++) {
+                            double kernel_time;
+                            double wall_time = measure_once(backend, &variant, spec->a, spec->b, n, mode, func, &kernel_time, &result);
+                            if (wall_time < 0.0) {
+                                status = -1;
+                                break;
+                            }
+                            if (run >= spec->warmup) {
+                                kernel_samples[run - spec->warmup] = kernel_time;
+                                wall_samples[run - spec->warmup] = wall_time;
+                            }
+                        }
+
+                        if (status != 0) {
+                            break;
+                        }
+
+                        BenchStats kernel_stats, wall_stats;
+                        summarize_samples(kernel_samples, spec->repeat, &kernel_stats);
+                        summarize_samples(wall_samples, spec->repeat, &wall_stats);
+                        double error = fabs(result - exact_integral(spec->a, spec->b, func));
+
+                        if (spec->format == BENCH_JSON) {
+                            fprintf(out, "%s\n    {\"backend\": \"%s\", \"precision\": \"%s\", \"mode\": %d, \"func\": %d, \"a\": %.17g, \"b\": %.17g, \"n\": %lld, "
+                                    "\"kernel\": {\"median\": %.9e, \"p95\": %.9e, \"stddev\": %.9e}, "
+                                    "\"wall\": {\"median\": %.9e, \"p95\": %.9e, \"stddev\": %.9e}, "
+                                    "\"result\": %.17g, \"error\": %.9e}",
+                                    rows > 0 ? "," : "", backend_name, variant_name, mode, func, spec->a, spec->b, n,
+                                    kernel_stats.median, kernel_stats.p95, kernel_stats.stddev,
+                                    wall_stats.median, wall_stats.p95, wall_stats.stddev, result, error);
+                        } else {
+                            fprintf(out, "%s,%s,%d,%d,%.17g,%.17g,%lld,%.9e,%.9e,%.9e,%.9e,%.9e,%.9e,%.17g,%.9e\n",
+                                    backend_name, variant_name, mode, func, spec->a, spec->b, n,
+                                    kernel_stats.median, kernel_stats.p95, kernel_stats.stddev,
+                                    wall_stats.median, wall_stats.p95, wall_stats.stddev, result, error);
+                        }
+                        fflush(out);
+                        rows++;
+
+                        if (n > spec->n_stop / spec->n_factor) {
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (spec->format == BENCH_JSON) {
+        fprintf(out, "\n  ]\n}\n");
+    }
+
+    free(kernel_samples);
+    free(wall_samples);
+    if (status != 0) {
+        fprintf(stderr, "Benchmark stopped after %d rows.\n", rows);
+    }
+    return status;
+}
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <CL/cl.h>
+#include "cache_utils.h"
+#include "hash_utils.h"
+
+// The key covers everything that makes a binary incompatible: the device
+// model, its vendor and the driver that produced the binary.
+unsigned long long hash_device(cl_device_id device_id) {
+    const cl_device_info infos[] = { CL_DEVICE_NAME, CL_DEVICE_VENDOR, CL_DEVICE_VERSION, CL_DRIVER_VERSION };
+    unsigned long long hash = 0;
+    char buffer[256];
+
+    for (size_t i = 0; i < sizeof(infos) / sizeof(infos[0]); i++) {
+        size_t length = 0;
+        if (clGetDeviceInfo(device_id, infos[i], sizeof(buffer), buffer, &length) != CL_SUCCESS) {
+            continue;
+        }
+        hash = hash_bytes(buffer, length, hash);
+    }
+    return hash;
+}
+
+cl_program load_program_binary(cl_context context, cl_device_id device_id, const char *path, const char *options) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    rewind(file);
+    if (file_size <= 0) {
+        fclose(file);
+        return NULL;
+    }
+
+    unsigned char *binary = (unsigned char *)malloc(file_size);
+    if (!binary || fread(binary, 1, file_size, file) != (size_t)file_size) {
+        free(binary);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    size_t binary_size = file_size;
+    cl_int binary_status, ret;
+    cl_program program = clCreateProgramWithBinary(context, 1, &device_id, &binary_size, (const unsigned char **)&binary, &binary_status, &ret);
+    free(binary);
+
+    if (ret != CL_SUCCESS || binary_status != CL_SUCCESS) {
+        if (program) {
+            clReleaseProgram(program);
+        }
+        return NULL;
+    }
+
+    // A binary still has to be "built" before kernels can be created, but the
+    // driver only links it here instead of running the compiler.
+    ret = clBuildProgram(program, 1, &device_id, options, NULL, NULL);
+    if (ret != CL_SUCCESS) {
+        clReleaseProgram(program);
+        return NULL;
+    }
+
+    return program;
+}
+
+int save_program_binary(cl_program program, const char *path) {
+    size_t binary_size;
+    cl_int ret = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binary_size, NULL);
+    if (ret != CL_SUCCESS || binary_size == 0) {
+        return -1;
+    }
+
+    unsigned char *binary = (unsigned char *)malloc(binary_size);
+    if (!binary) {
+        return -1;
+    }
+
+    ret = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char *), &binary, NULL);
+    if (ret != CL_SUCCESS) {
+        free(binary);
+        return -1;
+    }
+
+    mkdir(get_cache_dir(), 0755);
+
+    // Write to a temporary file first so concurrent runs never see a
+    // partially written binary.
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        free(binary);
+        return -1;
+    }
+
+    size_t written = fwrite(binary, 1, binary_size, file);
+    fclose(file);
+    free(binary);
+
+    if (written != binary_size || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "cpu_utils.h"
+#include "expr_utils.h"
+#include "hash_utils.h"
+#include "time_utils.h"
+
+double integrableFunction(double x, int func)
+{
+    switch(func) {
+        case 0: return sin(x);
+        case 1: return cos(x);
+        case 2: return exp(x);
+        case 3: return sqrt(x);
+        default: return log(x);
+    }
+}
+
+// Interior points 1..n-1 are split statically across the threads, and each
+// thread keeps its own partial sum. The function switch is hoisted out of the
+// loop, so the body is branch-free and the compiler can map sin/cos/exp/log
+// onto the vector math library (libmvec) and sqrt onto vector instructions.
+#define WEIGHTED_SUM(expr) \
+    _Pragma("omp parallel for simd reduction(+:sum) schedule(static)") \
+    for (long long i = 1; i < n; i++) { \
+        double x = a + i * h; \
+        sum += ((i & 1) ? w_odd : w_even) * (expr); \
+    }
+
+double weighted_interior_sum(double a, double h, long long n, int func, double w_odd, double w_even)
+{
+    double sum = 0.0;
+
+    switch(func) {
+        case 0: WEIGHTED_SUM(sin(x)); break;
+        case 1: WEIGHTED_SUM(cos(x)); break;
+        case 2: WEIGHTED_SUM(exp(x)); break;
+        case 3: WEIGHTED_SUM(sqrt(x)); break;
+        default: WEIGHTED_SUM(log(x)); break;
+    }
+
+    return sum;
+}
+
+// Same weighting as the device kernels (ends 1, interior w_odd/w_even) over
+// the point indices [start, end) only, so a range can be split between the
+// CPU and OpenCL devices.
+#define RANGE_SUM(expr) \
+    _Pragma("omp parallel for simd reduction(+:sum) schedule(static)") \
+    for (long long i = start; i < end; i++) { \
+        double x = a + i * h; \
+        double w = (i == 0 || i == n) ? 1.0 : ((i & 1) ? w_odd : w_even); \
+        sum += w * (expr); \
+    }
+
+double weighted_range_sum(double a, double h, long long start, long long end, long long n, int mode, int func, const CompiledExpression *compiled)
+{
+    double w_odd, w_even;
+    double sum = 0.0;
+
+    switch (mode) {
+        case 0: w_odd = 4.0; w_even = 2.0; break;
+        case 1: w_odd = 1.0; w_even = 1.0; break;
+        default: w_odd = 2.0; w_even = 2.0; break;
+    }
+
+    if (compiled != NULL) {
+        double (*integrand)(double) = compiled->integrand;
+        RANGE_SUM(integrand(x));
+        return sum;
+    }
+
+    switch(func) {
+        case 0: RANGE_SUM(sin(x)); break;
+        case 1: RANGE_SUM(cos(x)); break;
+        case 2: RANGE_SUM(exp(x)); break;
+        case 3: RANGE_SUM(sqrt(x)); break;
+        default: RANGE_SUM(log(x)); break;
+    }
+
+    return sum;
+}
+
+// EXPR_CFLAGS has -march=native, so a shared cache must not hand one host's
+// object to another: the first processor block of /proc/cpuinfo (model and
+// feature flags), or the machine name where that is missing, goes into the key.
+unsigned long long hash_host_cpu(unsigned long long key) {
+    static const char *fields[] = { "vendor_id", "model name", "flags", "Features", "CPU implementer", "CPU part", NULL };
+    FILE *file = fopen("/proc/cpuinfo", "r");
+    if (file == NULL) {
+        struct utsname name;
+        if (uname(&name) == 0) {
+            key = hash_bytes(name.machine, strlen(name.machine), key);
+        }
+        return key;
+    }
+
+    char line[4096];
+    while (fgets(line, sizeof(line), file) != NULL && line[0] != '\n') {
+        for (int i = 0; fields[i] != NULL; i++) {
+            if (strncmp(line, fields[i], strlen(fields[i])) == 0) {
+                key = hash_bytes(line, strlen(line), key);
+            }
+        }
+    }
+    fclose(file);
+    return key;
+}
+
+// Runs "$CC EXPR_CFLAGS -o output source -lm" without a shell, so cache paths
+// with spaces or shell characters are passed through unchanged. CC may hold
+// several words (e.g. "ccache gcc").
+static int run_compiler(const char *cc, const char *output, const char *source) {
+    char words[1024];
+    snprintf(words, sizeof(words), "%s %s", cc, EXPR_CFLAGS);
+
+    char *argv[64];
+    int argc = 0;
+    for (char *word = strtok(words, " \t"); word != NULL && argc < 59; word = strtok(NULL, " \t")) {
+        argv[argc++] = word;
+    }
+    argv[argc++] = "-o";
+    argv[argc++] = (char *)output;
+    argv[argc++] = (char *)source;
+    argv[argc++] = "-lm";
+    argv[argc] = NULL;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        perror(argv[0]);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) != pid) {
+        return -1;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+// The generated source is hashed together with the compiler, its flags and
+// the host CPU, so an expression is compiled once per machine and later runs
+// only dlopen the cached shared object. Source and object are written under
+// per-process names and the object is renamed into place, so concurrent
+// processes never see each other's partial files.
+int compile_expression(const char *expr, CompiledExpression *compiled)
+{
+    char code[MAX_EXPR_CODE];
+    char message[256];
+    if (expr_to_code(expr, code, sizeof(code), message, sizeof(message)) != 0) {
+        fprintf(stderr, "Invalid expression \"%s\": %s\n", expr, message);
+        return -1;
+    }
+
+    const char *cc = getenv("CC");
+    if (cc == NULL || cc[0] == '\0') {
+        cc = "cc";
+    }
+
+    char *source = expr_c_source(code);
+    unsigned long long key = hash_bytes(source, strlen(source), 0);
+    key = hash_bytes(EXPR_CFLAGS, strlen(EXPR_CFLAGS), key);
+    key = hash_bytes(cc, strlen(cc), key);
+    key = hash_host_cpu(key);
+
+    char so_path[1024], c_path[1100], tmp_path[1100];
+    get_cache_path(so_path, sizeof(so_path), "expr", key, "so");
+    snprintf(c_path, sizeof(c_path), "%s.%d.c", so_path, (int)getpid());
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", so_path, (int)getpid());
+
+    if (access(so_path, R_OK) != 0) {
+        mkdir(get_cache_dir(), 0755);
+
+        FILE *file = fopen(c_path, "w");
+        if (file == NULL) {
+            fprintf(stderr, "Could not write %s\n", c_path);
+            free(source);
+            return -1;
+        }
+        fputs(source, file);
+        fclose(file);
+
+        int failed = run_compiler(cc, tmp_path, c_path) != 0 || rename(tmp_path, so_path) != 0;
+        remove(c_path);
+        if (failed) {
+            fprintf(stderr, "Failed to compile expression with %s %s\n", cc, EXPR_CFLAGS);
+            remove(tmp_path);
+            free(source);
+            return -1;
+        }
+    }
+    free(source);
+
+    compiled->handle = dlopen(so_path, RTLD_NOW);
+    if (compiled->handle == NULL) {
+        fprintf(stderr, "Failed to load %s: %s\n", so_path, dlerror());
+        return -1;
+    }
+
+    *(void **)&compiled->integrand = dlsym(compiled->handle, "user_integrand");
+    *(void **)&compiled->weighted_sum = dlsym(compiled->handle, "user_weighted_sum");
+    if (compiled->integrand == NULL || compiled->weighted_sum == NULL) {
+        fprintf(stderr, "Missing symbols in %s\n", so_path);
+        dlclose(compiled->handle);
+        return -1;
+    }
+
+    return 0;
+}
+
+void release_expression(CompiledExpression *compiled)
+{
+    dlclose(compiled->handle);
+    compiled->handle = NULL;
+}
+
+double calculate_integral(double h, long long size, int mode, int func, double a, double b, const CompiledExpression *expr)
+{
+    long long n = size;
+    double ends, w_odd, w_even, factor;
+
+    switch (mode) {
+        case 0: w_odd = 4.0; w_even = 2.0; factor = h/3; break; // simpson
+        case 1: w_odd = 1.0; w_even = 1.0; factor = h; break;   // rectangle
+        case 2: w_odd = 2.0; w_even = 2.0; factor = h/2; break; // trapezoidal
+        default: return -1;
+    }
+
+    if (expr != NULL) {
+        ends = expr->integrand(a) + expr->integrand(b);
+        return factor * (ends + expr->weighted_sum(a, h, n, w_odd, w_even));
+    }
+
+    ends = integrableFunction(a, func) + integrableFunction(b, func);
+    return factor * (ends + weighted_interior_sum(a, h, n, func, w_odd, w_even));
+}
+
+// One request on the CPU backend; elapsed_time covers the integration only.
+// Returns 0, or -1 for an invalid mode.
+int run_cpu(const CompiledExpression *compiled, double a, double b, long long size, int mode, int func, double *final_result, double *elapsed_time) {
+    if (mode < 0 || mode > 2) {
+        fprintf(stderr, "Invalid mode selected.\n");
+        return -1;
+    }
+
+    struct timespec start_t, end_t;
+    clock_gettime(CLOCK_MONOTONIC, &start_t);
+    *final_result = calculate_integral((b - a) / size, size, mode, func, a, b, compiled);
+    clock_gettime(CLOCK_MONOTONIC, &end_t);
+
+    *elapsed_time = get_elapsed_time(start_t, end_t);
+    return 0;
+}
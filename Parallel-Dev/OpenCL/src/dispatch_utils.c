@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "dispatch_utils.h"
+#include "bench_utils.h"
+#include "hash_utils.h"
+#include "input_utils.h"
+#include "cpu_utils.h"
+#include "opencl_utils.h"
+
+// The last model used, and the program variant it belongs to.
+static DispatchModel cached_model;
+static int model_ready = 0;
+static int cached_precision, cached_native_math, cached_vector_width;
+
+static void get_dispatch_path(char *path, size_t path_size) {
+    snprintf(path, path_size, "%s/%s", get_cache_dir(), DISPATCH_FILE);
+}
+
+// Like the tuning file: one "<key> <cpu_overhead> <cpu_per_point>
+// <opencl_overhead> <opencl_per_point>" line per program variant and host,
+// appended, so the last match wins.
+int load_dispatch_model(unsigned long long key, DispatchModel *model) {
+    char path[1024];
+    get_dispatch_path(path, sizeof(path));
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    int found = -1;
+    unsigned long long entry_key;
+    DispatchModel entry;
+    while (fscanf(file, "%llx %lf %lf %lf %lf", &entry_key, &entry.cpu_overhead, &entry.cpu_per_point, &entry.opencl_overhead, &entry.opencl_per_point) == 5) {
+        if (entry_key == key) {
+            entry.opencl_available = 1;
+            *model = entry;
+            found = 0;
+        }
+    }
+
+    fclose(file);
+    return found;
+}
+
+int save_dispatch_model(unsigned long long key, const DispatchModel *model) {
+    char path[1024];
+    get_dispatch_path(path, sizeof(path));
+
+    mkdir(get_cache_dir(), 0755);
+    FILE *file = fopen(path, "a");
+    if (file == NULL) {
+        return -1;
+    }
+
+    fprintf(file, "%016llx %.9e %.9e %.9e %.9e\n", key, model->cpu_overhead, model->cpu_per_point, model->opencl_overhead, model->opencl_per_point);
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+// Fastest of CALIBRATION_REPEATS end-to-end requests, after one warmup run
+// that fills the program cache and the tuning file. -1 if the backend fails.
+static double calibration_time(int backend, const Options *options, long long n) {
+    double best = -1.0;
+    for (int run = 0; run <= CALIBRATION_REPEATS; run++) {
+        double kernel_time, result;
+        double wall_time = measure_once(backend, options, 2.0, 10.0, n, 0, 0, &kernel_time, &result);
+        if (wall_time < 0.0) {
+            return -1.0;
+        }
+        if (run > 0 && (best < 0.0 || wall_time < best)) {
+            best = wall_time;
+        }
+    }
+    return best;
+}
+
+static void fit_line(double small_time, double large_time, double *overhead, double *per_point) {
+    *per_point = (large_time - small_time) / (double)(CALIBRATION_LARGE_N - CALIBRATION_SMALL_N);
+    if (*per_point < 1e-15) {
+        *per_point = 1e-15;
+    }
+    *overhead = small_time - *per_point * CALIBRATION_SMALL_N;
+    if (*overhead < 0.0) {
+        *overhead = 0.0;
+    }
+}
+
+// The model is measured on the built-in integrand in one launch, so only
+// the options that select the program variant matter.
+static Options calibration_options(const Options *options) {
+    Options calibration = *options;
+    calibration.expr = NULL;
+    calibration.chunk_size = 0;
+    calibration.backend = BACKEND_OPENCL;
+    return calibration;
+}
+
+// Times both backends on the built-in Simpson/sin case at a small and a large
+// n and fits the two-parameter model to each. OpenCL goes first; if it fails
+// the model is marked unavailable and -1 returned.
+int calibrate_dispatch(DispatchModel *model, const Options *options) {
+    Options calibration = calibration_options(options);
+
+    fprintf(stderr, "Calibrating CPU/OpenCL crossover...\n");
+    double opencl_small = calibration_time(BACKEND_OPENCL, &calibration, CALIBRATION_SMALL_N);
+    double opencl_large = opencl_small < 0.0 ? -1.0 : calibration_time(BACKEND_OPENCL, &calibration, CALIBRATION_LARGE_N);
+    if (opencl_large < 0.0) {
+        model->opencl_available = 0;
+        return -1;
+    }
+    fit_line(opencl_small, opencl_large, &model->opencl_overhead, &model->opencl_per_point);
+    fit_line(calibration_time(BACKEND_CPU, &calibration, CALIBRATION_SMALL_N),
+             calibration_time(BACKEND_CPU, &calibration, CALIBRATION_LARGE_N),
+             &model->cpu_overhead, &model->cpu_per_point);
+    model->opencl_available = 1;
+    fprintf(stderr, "Crossover at about %lld points\n", dispatch_crossover(model));
+    return 0;
+}
+
+// Read (or measured) once per process and program variant. The key is the
+// program_key of the calibration variant, so device, driver, precision and
+// vector width all separate models, plus the host CPU the other side ran
+// on. No OpenCL device, or one that fails to calibrate, means CPU only.
+void get_dispatch_model(DispatchModel *model, const Options *options) {
+    if (!model_ready || cached_precision != options->precision || cached_native_math != options->native_math || cached_vector_width != options->vector_width) {
+        Options calibration = calibration_options(options);
+        unsigned long long key;
+        if (options_program_key(KERNEL_FILE, &calibration, &key) != 0) {
+            fprintf(stderr, "OpenCL unavailable; the auto backend uses the CPU.\n");
+            cached_model.opencl_available = 0;
+        } else {
+            key = hash_host_cpu(key);
+            if (options->calibrate || load_dispatch_model(key, &cached_model) != 0) {
+                if (calibrate_dispatch(&cached_model, options) != 0) {
+                    fprintf(stderr, "OpenCL calibration failed; the auto backend uses the CPU.\n");
+                } else if (save_dispatch_model(key, &cached_model) != 0) {
+                    fprintf(stderr, "Warning: could not write dispatch model in %s\n", get_cache_dir());
+                }
+            }
+        }
+        cached_precision = options->precision;
+        cached_native_math = options->native_math;
+        cached_vector_width = options->vector_width;
+        model_ready = 1;
+    }
+    *model = cached_model;
+}
+
+// A batch of jobs pays the CPU overhead per job but the OpenCL overhead once.
+int choose_backend(const DispatchModel *model, int jobs, long long points) {
+    if (!model->opencl_available) {
+        return BACKEND_CPU;
+    }
+    double cpu_time = jobs * model->cpu_overhead + model->cpu_per_point * points;
+    double opencl_time = model->opencl_overhead + model->opencl_per_point * points;
+    return cpu_time <= opencl_time ? BACKEND_CPU : BACKEND_OPENCL;
+}
+
+// Point count above which a single request is cheaper on OpenCL, or -1 if
+// the CPU is never slower.
+long long dispatch_crossover(const DispatchModel *model) {
+    if (!model->opencl_available) {
+        return -1;
+    }
+    double slope = model->cpu_per_point - model->opencl_per_point;
+    if (slope <= 0.0) {
+        return -1;
+    }
+    double points = (model->opencl_overhead - model->cpu_overhead) / slope;
+    return points > 0.0 ? (long long)points : 0;
+}
+
+int resolve_backend(const Options *options, int jobs, long long points) {
+    if (options->backend != BACKEND_AUTO) {
+        return options->backend;
+    }
+
+    DispatchModel model;
+    get_dispatch_model(&model, options);
+    return choose_backend(&model, jobs, points);
+}
@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include "expr_utils.h"
+
+// Recursive-descent parser for integrands in x and the sweep parameter p
+// (1 outside --sweep). It validates the expression and emits a fully
+// parenthesized equivalent that is valid as both C and OpenCL C: every number
+// becomes a double literal and a^b becomes pow(a, b).
+//
+//   expr    := term (('+' | '-') term)*
+//   term    := unary (('*' | '/') unary)*
+//   unary   := ('-' | '+') unary | power
+//   power   := primary ('^' unary)?
+//   primary := number | 'x' | 'p' | 'pi' | name '(' expr (',' expr)? ')' | '(' expr ')'
+//
+// Every nesting level (parenthesis, function call, sign, exponent) recurses
+// through parse_unary; depth caps it so hostile input fails instead of
+// overflowing the stack.
+
+#define MAX_EXPR_DEPTH 256
+
+typedef struct {
+    const char *input;
+    const char *pos;
+    char *out;
+    size_t out_size;
+    size_t length;
+    char *error;
+    size_t error_size;
+    int failed;
+    int depth;
+} ExprParser;
+
+static const char *unary_functions[] = {
+    "sin", "cos", "tan", "asin", "acos", "atan", "sinh", "cosh", "tanh",
+    "exp", "log", "log10", "sqrt", "cbrt", "fabs", "floor", "ceil", NULL
+};
+
+static const char *binary_functions[] = { "pow", "atan2", "fmin", "fmax", NULL };
+
+static void parse_expr(ExprParser *p);
+
+static void fail(ExprParser *p, const char *message) {
+    if (!p->failed) {
+        snprintf(p->error, p->error_size, "%s at position %d", message, (int)(p->pos - p->input));
+        p->failed = 1;
+    }
+}
+
+static void emit(ExprParser *p, const char *text) {
+    size_t text_length = strlen(text);
+    if (p->length + text_length + 1 > p->out_size) {
+        fail(p, "Expression too long");
+        return;
+    }
+    memcpy(p->out + p->length, text, text_length + 1);
+    p->length += text_length;
+}
+
+static void skip_spaces(ExprParser *p) {
+    while (isspace((unsigned char)*p->pos)) {
+        p->pos++;
+    }
+}
+
+static int accept(ExprParser *p, char c) {
+    skip_spaces(p);
+    if (*p->pos == c) {
+        p->pos++;
+        return 1;
+    }
+    return 0;
+}
+
+static int find_name(const char **names, const char *name) {
+    for (int i = 0; names[i] != NULL; i++) {
+        if (strcmp(names[i], name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void parse_primary(ExprParser *p) {
+    if (p->failed) {
+        return;
+    }
+    skip_spaces(p);
+
+    if (isdigit((unsigned char)*p->pos) || *p->pos == '.') {
+        char *end;
+        errno = 0;
+        double value = strtod(p->pos, &end);
+        if (end == p->pos) {
+            fail(p, "Invalid number");
+            return;
+        }
+        // strtod overflows to inf, which has no literal. Checked via errno
+        // because the CPU objects are built with -ffast-math.
+        if (errno == ERANGE && fabs(value) > 1.0) {
+            fail(p, "Number out of range");
+            return;
+        }
+        char number[64];
+        snprintf(number, sizeof(number), "%.17e", value);
+        emit(p, number);
+        p->pos = end;
+        return;
+    }
+
+    if (isalpha((unsigned char)*p->pos)) {
+        char name[16];
+        size_t length = 0;
+        while (isalnum((unsigned char)*p->pos) || *p->pos == '_') {
+            if (length + 1 >= sizeof(name)) {
+                fail(p, "Identifier too long");
+                return;
+            }
+            name[length++] = *p->pos++;
+        }
+        name[length] = '\0';
+
+        if (strcmp(name, "x") == 0 || strcmp(name, "p") == 0) {
+            emit(p, name);
+            return;
+        }
+        if (strcmp(name, "pi") == 0) {
+            emit(p, "3.14159265358979323846e+00");
+            return;
+        }
+
+        int is_binary = find_name(binary_functions, name);
+        if (!is_binary && !find_name(unary_functions, name)) {
+            fail(p, "Unknown identifier");
+            return;
+        }
+        if (!accept(p, '(')) {
+            fail(p, "Expected '(' after function name");
+            return;
+        }
+
+        emit(p, name);
+        emit(p, "(");
+        parse_expr(p);
+        if (is_binary) {
+            if (!accept(p, ',')) {
+                fail(p, "Expected ','");
+                return;
+            }
+            emit(p, ", ");
+            parse_expr(p);
+        }
+        if (!accept(p, ')')) {
+            fail(p, "Expected ')'");
+            return;
+        }
+        emit(p, ")");
+        return;
+    }
+
+    if (accept(p, '(')) {
+        emit(p, "(");
+        parse_expr(p);
+        if (!accept(p, ')')) {
+            fail(p, "Expected ')'");
+            return;
+        }
+        emit(p, ")");
+        return;
+    }
+
+    fail(p, "Unexpected character");
+}
+
+static void parse_unary(ExprParser *p);
+
+static void parse_power(ExprParser *p) {
+    size_t base_start = p->length;
+    parse_primary(p);
+    if (p->failed || !accept(p, '^')) {
+        return;
+    }
+
+    // Rewrite "base" into "pow(base, exponent)" in place.
+    const char *prefix = "pow(";
+    size_t prefix_length = strlen(prefix);
+    if (p->length + prefix_length + 1 > p->out_size) {
+        fail(p, "Expression too long");
+        return;
+    }
+    memmove(p->out + base_start + prefix_length, p->out + base_start, p->length - base_start + 1);
+    memcpy(p->out + base_start, prefix, prefix_length);
+    p->length += prefix_length;
+
+    emit(p, ", ");
+    parse_unary(p);
+    emit(p, ")");
+}
+
+static void parse_unary(ExprParser *p) {
+    if (p->failed) {
+        return;
+    }
+    if (p->depth == MAX_EXPR_DEPTH) {
+        fail(p, "Expression nested too deeply");
+        return;
+    }
+    p->depth++;
+    if (accept(p, '-')) {
+        emit(p, "(-");
+        parse_unary(p);
+        emit(p, ")");
+    } else if (accept(p, '+')) {
+        parse_unary(p);
+    } else {
+        parse_power(p);
+    }
+    p->depth--;
+}
+
+static void parse_term(ExprParser *p) {
+    parse_unary(p);
+    while (!p->failed) {
+        if (accept(p, '*')) {
+            emit(p, " * ");
+        } else if (accept(p, '/')) {
+            emit(p, " / ");
+        } else {
+            return;
+        }
+        parse_unary(p);
+    }
+}
+
+static void parse_expr(ExprParser *p) {
+    if (p->failed) {
+        return;
+    }
+    emit(p, "(");
+    parse_term(p);
+    while (!p->failed) {
+        if (accept(p, '+')) {
+            emit(p, " + ");
+        } else if (accept(p, '-')) {
+            emit(p, " - ");
+        } else {
+            break;
+        }
+        parse_term(p);
+    }
+    emit(p, ")");
+}
+
+int expr_to_code(const char *expr, char *code, size_t code_size, char *error, size_t error_size) {
+    ExprParser parser = { expr, expr, code, code_size, 0, error, error_size, 0, 0 };
+    code[0] = '\0';
+
+    parse_expr(&parser);
+    skip_spaces(&parser);
+    if (!parser.failed && *parser.pos != '\0') {
+        fail(&parser, "Unexpected trailing input");
+    }
+
+    return parser.failed ? -1 : 0;
+}
+
+// Prepended to integral_kernel.cl, which wraps USER_EXPRESSION in
+// user_integrand() and user_param_integrand() of its own precision, so the
+// fp32 variant stays float throughout. USER_INTEGRAND makes integrand() and
+// param_integrand() call those instead of switching on func.
+char* expr_opencl_prefix(const char *code) {
+    const char *format =
+        "#define USER_INTEGRAND\n"
+        "#define USER_EXPRESSION %s\n"
+        "\n";
+    size_t size = strlen(format) + strlen(code) + 1;
+    char *prefix = (char *)malloc(size);
+    if (prefix != NULL) {
+        snprintf(prefix, size, format, code);
+    }
+    return prefix;
+}
+
+// Stand-alone C translation unit for the CPU backend: the integrand and the
+// weighted interior sum, written so the loop vectorizes like the built-in one.
+char* expr_c_source(const char *code) {
+    const char *format =
+        "#include <math.h>\n"
+        "\n"
+        "static const double p = 1.0;\n"
+        "\n"
+        "double user_integrand(double x) {\n"
+        "    return %s;\n"
+        "}\n"
+        "\n"
+        "double user_weighted_sum(double a, double h, long long n, double w_odd, double w_even) {\n"
+        "    double sum = 0.0;\n"
+        "    #pragma omp parallel for simd reduction(+:sum) schedule(static)\n"
+        "    for (long long i = 1; i < n; i++) {\n"
+        "        double x = a + i * h;\n"
+        "        sum += ((i & 1) ? w_odd : w_even) * (%s);\n"
+        "    }\n"
+        "    return sum;\n"
+        "}\n";
+    size_t size = strlen(format) + 2 * strlen(code) + 1;
+    char *source = (char *)malloc(size);
+    if (source != NULL) {
+        snprintf(source, size, format, code, code);
+    }
+    return source;
+}
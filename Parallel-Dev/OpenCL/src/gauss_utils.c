@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <CL/cl.h>
+#include "gauss_utils.h"
+#include "opencl_utils.h"
+#include "input_utils.h"
+#include "trace_utils.h"
+
+// Nodes and weights of the order-point Gauss-Legendre rule on [-1, 1]:
+// Newton's method on P_order from the Chebyshev-like initial guess, with the
+// three-term recurrence for P and its derivative. The rule is symmetric, so
+// only half of the roots are iterated.
+void gauss_legendre_rule(int order, double* nodes, double* weights) {
+    for (int i = 0; i < (order + 1) / 2; i++) {
+        double x = cos(M_PI * (i + 0.75) / (order + 0.5));
+        double derivative = 1.0;
+
+        for (int step = 0; step < GAUSS_NEWTON_STEPS; step++) {
+            double p0 = 1.0;
+            double p1 = x;
+            for (int k = 2; k <= order; k++) {
+                double p2 = ((2 * k - 1) * x * p1 - (k - 1) * p0) / k;
+                p0 = p1;
+                p1 = p2;
+            }
+            derivative = order * (x * p1 - p0) / (x * x - 1.0);
+
+            double dx = p1 / derivative;
+            x -= dx;
+            if (fabs(dx) < 1e-16) {
+                break;
+            }
+        }
+
+        double weight = 2.0 / ((1.0 - x * x) * derivative * derivative);
+        nodes[i] = -x;
+        nodes[order - 1 - i] = x;
+        weights[i] = weight;
+        weights[order - 1 - i] = weight;
+    }
+}
+
+// Composite Gauss-Legendre over panels equal panels of [a, b]. The nodes and
+// weights go to the device once per call as __constant arguments; the panel
+// sums feed the usual on-device reduction. elapsed_time receives the kernel
+// time; returns 0, or -1 on invalid arguments or an OpenCL failure.
+int run_gauss_legendre(OpenCLEngine* engine, double a, double b, long long panels, int order, int func, double* final_result, double* exact_value, double* error, double* elapsed_time) {
+    if (order < 1 || order > GAUSS_MAX_ORDER) {
+        fprintf(stderr, "Gauss-Legendre order must be between 1 and %d.\n", GAUSS_MAX_ORDER);
+        return -1;
+    }
+    if (panels < 1) {
+        fprintf(stderr, "Need at least one panel.\n");
+        return -1;
+    }
+
+    double nodes[GAUSS_MAX_ORDER];
+    double weights[GAUSS_MAX_ORDER];
+    gauss_legendre_rule(order, nodes, weights);
+
+    cl_int ret;
+    cl_kernel gl_kernel = clCreateKernel(engine->program, "gauss_legendre_kernel", &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create Gauss-Legendre kernel. Error: %d\n", ret);
+        return -1;
+    }
+
+    size_t local_item_size = engine->local_size;
+    size_t global_item_size = kernel_global_size(engine, panels);
+    size_t num_work_groups = global_item_size / local_item_size;
+    double h = (b - a) / panels;
+    cl_long panel_count = panels;
+
+    cl_mem nodes_mem = NULL, weights_mem = NULL, partial_sums_mem = NULL;
+    cl_event gl_event = NULL;
+    int status = -1;
+
+    nodes_mem = create_real_buffer(engine, nodes, order, &ret);
+    if (ret == CL_SUCCESS) {
+        weights_mem = create_real_buffer(engine, weights, order, &ret);
+    }
+    if (ret == CL_SUCCESS) {
+        partial_sums_mem = clCreateBuffer(engine->context, CL_MEM_READ_WRITE, num_work_groups * 2 * engine->real_size, NULL, &ret);
+    }
+
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create Gauss-Legendre buffers. Error: %d\n", ret);
+    } else {
+        ret = set_real_arg(engine, gl_kernel, 0, a);
+        ret |= set_real_arg(engine, gl_kernel, 1, h);
+        ret |= clSetKernelArg(gl_kernel, 2, sizeof(cl_long), (void *)&panel_count);
+        ret |= clSetKernelArg(gl_kernel, 3, sizeof(int), (void *)&order);
+        ret |= clSetKernelArg(gl_kernel, 4, sizeof(int), (void *)&func);
+        ret |= clSetKernelArg(gl_kernel, 5, sizeof(cl_mem), (void *)&nodes_mem);
+        ret |= clSetKernelArg(gl_kernel, 6, sizeof(cl_mem), (void *)&weights_mem);
+        ret |= clSetKernelArg(gl_kernel, 7, sizeof(int), (void *)&engine->compensated);
+        ret |= clSetKernelArg(gl_kernel, 8, sizeof(cl_mem), (void *)&partial_sums_mem);
+        ret |= clSetKernelArg(gl_kernel, 9, local_item_size * engine->real_size, NULL);
+        ret |= clSetKernelArg(gl_kernel, 10, local_item_size * engine->real_size, NULL);
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to set Gauss-Legendre kernel arguments. Error: %d\n", ret);
+        } else if ((ret = clEnqueueNDRangeKernel(engine->command_queue, gl_kernel, 1, NULL, &global_item_size, &local_item_size, 0, NULL, &gl_event)) != CL_SUCCESS) {
+            fprintf(stderr, "Failed to enqueue Gauss-Legendre kernel. Error: %d\n", ret);
+            gl_event = NULL;
+        } else {
+            clWaitForEvents(1, &gl_event);
+            trace_command("gauss_legendre_kernel", gl_event);
+            *elapsed_time = event_seconds(gl_event);
+
+            double sum;
+            status = reduce_on_device(engine, partial_sums_mem, num_work_groups, &sum, elapsed_time);
+            if (status == 0) {
+                *final_result = 0.5 * h * sum;
+                *exact_value = exact_integral(a, b, func);
+                *error = fabs(*final_result - *exact_value);
+            }
+        }
+    }
+
+    if (gl_event != NULL) {
+        clReleaseEvent(gl_event);
+    }
+    clReleaseKernel(gl_kernel);
+    release_mem(nodes_mem);
+    release_mem(weights_mem);
+    release_mem(partial_sums_mem);
+
+    return status;
+}
@@ -0,0 +1,28 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include "hash_utils.h"
+
+#define FNV_OFFSET 1469598103934665603ULL
+#define FNV_PRIME 1099511628211ULL
+
+// 64-bit FNV-1a. A zero seed starts a new hash; passing a previous result
+// continues it, so several buffers can be hashed as one key.
+unsigned long long hash_bytes(const void *data, size_t length, unsigned long long seed) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    unsigned long long hash = seed ? seed : FNV_OFFSET;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+const char* get_cache_dir(void) {
+    const char *dir = getenv(CACHE_DIR_ENV);
+    return (dir != NULL && dir[0] != '\0') ? dir : DEFAULT_CACHE_DIR;
+}
+
+void get_cache_path(char *path, size_t path_size, const char *prefix, unsigned long long key, const char *extension) {
+    snprintf(path, path_size, "%s/%s_%016llx.%s", get_cache_dir(), prefix, key, extension);
+}
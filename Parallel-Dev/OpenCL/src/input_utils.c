@@ -1,67 +1,256 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <math.h>
-#include "input_utils.h"
-
-void get_points(double array[], double a, double b, int size, double h) {
-    for (int i = 0; i <= size; i++) {
-        array[i] = a + i * h;
-    }
-}
-
-void print_usage(const char *prog_name) {
-    printf("Usage: %s <a> <b> <n> <mode> <func> [--complexity <input_file>] [--simpson <dim> <lower0> <upper0> <n0> ... <lowerN> <upperN> <nN> <func>] [--help]\n", prog_name);
-}
-
-void print_help(const char *prog_name) {
-    print_usage(prog_name);
-    printf("Arguments:\n");
-    printf("  a     - Lower bound of the integral (double)\n");
-    printf("  b     - Upper bound of the integral (double)\n");
-    printf("  n     - Number of intervals (int)\n");
-    printf("  mode  - Integration method (0: Simpson, 1: Rectangle, 2: Trapezoidal)\n");
-    printf("  func  - Function to integrate (0: sin, 1: cos, 2: exp, 3: sqrt, 4: log)\n");
-    printf("Options:\n");
-    printf("  --complexity <input_file> - Measure the complexity using parameters from the input file\n");
-    printf("  --simpson <dim> <lower0> <upper0> <n0> ... <lowerN> <upperN> <nN> <func> - Perform multi-dimensional Simpson integration\n");
-    printf("  --help                    - Show this help message\n");
-}
-
-double exact_integral(double a, double b, int func) {
-    switch (func) {
-        case 0: return -cos(b) + cos(a); // sin(x)
-        case 1: return sin(b) - sin(a);  // cos(x)
-        case 2: return exp(b) - exp(a);  // exp(x)
-        case 3: return (2.0 / 3.0) * (pow(b, 1.5) - pow(a, 1.5)); // sqrt(x)
-        case 4: return b * log(b) - b - (a * log(a) - a); // log(x)
-        default: return 0.0;
-    }
-}
-
-int read_params(const char *filename, Params *params) {
-    FILE *file = fopen(filename, "r");
-    if (file == NULL) {
-        fprintf(stderr, "File couldn't be opened: %s\n", filename);
-        return -1;
-    }
-
-    int count = 0;
-    while (fscanf(file, "%lf %lf %d %d %d", &params[count].a, &params[count].b, &params[count].n, &params[count].mode, &params[count].func) != EOF) {
-        count++;
-    }
-
-    fclose(file);
-    return count;
-}
-
-void least_squares(double *x, double *y, int n, double *a, double *b) {
-    double sum_x = 0.0, sum_y = 0.0, sum_xx = 0.0, sum_xy = 0.0;
-    for (int i = 0; i < n; i++) {
-        sum_x += x[i];
-        sum_y += y[i];
-        sum_xx += x[i] * x[i];
-        sum_xy += x[i] * y[i];
-    }
-    *a = (n * sum_xy - sum_x * sum_y) / (n * sum_xx - sum_x * sum_x);
-    *b = (sum_y - (*a) * sum_x) / n;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "input_utils.h"
+
+// Shared by both programs: the sequential one builds libintegrate with
+// INTEGRATE_CPU_ONLY and takes only --expr.
+void print_usage(const char *prog_name) {
+#ifdef INTEGRATE_CPU_ONLY
+    printf("Usage: %s <a> <b> <n> <mode> <func>\n", prog_name);
+    printf("       %s --expr <expression> <a> <b> <n> <mode>\n", prog_name);
+#else
+    printf("Usage: %s <a> <b> <n> <mode> <func> [--complexity <input_file>] [--simpson <dim> <lower0> <upper0> <n0> ... <lowerN> <upperN> <nN> <func>] [--bench <spec_file>] [--batch <input_file>] [--sweep <param_file> <a> <b> <n> <mode> <func>] [--samples <file> <mode> [<a> <b>]] [--serve [socket_path]] [--adaptive <a> <b> <tol> <func>] [--romberg <a> <b> <tol> <func>] [--tanh-sinh <a> <b> <tol> <func>] [--gauss <order> <a> <b> <panels> <func>] [--qmc|--mc <dim> <lower0> <upper0> ... <lowerN> <upperN> <samples> <func>] [--replicates <r>] [--seed <s>] [--expr <expression>] [--compensated] [--chunk <points>] [--tune|--no-tune] [--multi [--cpu-share]] [--backend opencl|cpu|auto] [--calibrate] [--precision fp64|fp32|mixed] [--native-math] [--vector-width <w>] [--trace <file>] [--help]\n", prog_name);
+#endif
+}
+
+void print_help(const char *prog_name) {
+    print_usage(prog_name);
+    printf("Arguments:\n");
+    printf("  a     - Lower bound of the integral (double)\n");
+    printf("  b     - Upper bound of the integral (double)\n");
+    printf("  n     - Number of intervals (64-bit integer)\n");
+    printf("  mode  - Integration method (0: Simpson, 1: Rectangle, 2: Trapezoidal)\n");
+    printf("  func  - Function to integrate (0: sin, 1: cos, 2: exp, 3: sqrt, 4: log)\n");
+    printf("Options:\n");
+#ifdef INTEGRATE_CPU_ONLY
+    printf("  --expr <expression> - Integrate an expression in x instead of func, e.g. \"exp(-x*x)*cos(3*x)\"\n");
+#else
+    printf("  --complexity <input_file> - Measure the complexity using parameters from the input file\n");
+    printf("  --simpson <dim> <lower0> <upper0> <n0> ... <lowerN> <upperN> <nN> <func> - Perform multi-dimensional Simpson integration\n");
+    printf("      N-D func: 0: exp(-sum x_i^2), 1: sin(sum x_i), 2: cos(prod x_i), other: 1\n");
+    printf("  --bench <spec_file>       - Repeated sweep with warmup; median/p95/stddev of kernel and wall time as CSV or JSON\n");
+    printf("  --batch <input_file>      - Run every line of the input file as one batched launch\n");
+    printf("  --sweep <param_file> <a> <b> <n> <mode> <func> - Integrate func(p*x) for every p in the file in one 2D launch;\n");
+    printf("                              with --expr the expression may use p\n");
+    printf("  --samples <file> <mode> [<a> <b>] - Integrate tabulated samples (raw doubles, or with an INTSAMP1 header holding a and b),\n");
+    printf("                              streamed from a memory mapping in chunks of --chunk points (default 4M)\n");
+    printf("  --serve [socket_path]     - Keep the engine warm and answer 'a b n mode func' lines from stdin or a Unix socket;\n");
+    printf("                              requests arriving together share a batched launch, replies are '<value> <latency_us> <batch>'\n");
+    printf("  --adaptive <a> <b> <tol> <func> - Adaptive Gauss-Kronrod integration to the given tolerance\n");
+    printf("  --romberg <a> <b> <tol> <func>  - Romberg integration: grid doubling with Richardson extrapolation\n");
+    printf("  --tanh-sinh <a> <b> <tol> <func> - Double-exponential quadrature, for integrands singular at the end points (e.g. log from 0)\n");
+    printf("  --gauss <order> <a> <b> <panels> <func> - Composite Gauss-Legendre with order points per panel (order up to 64)\n");
+    printf("  --qmc <dim> <lower0> <upper0> ... <samples> <func> - Randomized quasi-Monte Carlo (Halton) over a box, N-D func as for --simpson\n");
+    printf("  --mc <dim> <lower0> <upper0> ... <samples> <func>  - Plain Monte Carlo with counter-based random numbers\n");
+    printf("  --replicates <r>          - Independent replicates for the --qmc/--mc error estimate (default 16)\n");
+    printf("  --seed <s>                - Seed for --qmc/--mc\n");
+    printf("  --expr <expression>       - Integrate an expression in x instead of func, e.g. \"exp(-x*x)*cos(3*x)\" (p is 1 outside --sweep)\n");
+    printf("  --compensated             - Use Neumaier-compensated summation in the device reductions\n");
+    printf("  --chunk <points>          - Stream the range through the device in chunks of <points> points\n");
+    printf("  --tune                    - Re-run the work-group size / work-per-item sweep for this device\n");
+    printf("  --no-tune                 - Skip autotuning and use the built-in launch geometry\n");
+    printf("  --multi                   - Split the range across every OpenCL device, weighted by measured throughput\n");
+    printf("  --cpu-share               - With --multi, also give a share to the CPU backend\n");
+    printf("  --backend <name>          - opencl (default), cpu, or auto: pick per request from the calibrated crossover\n");
+    printf("  --calibrate               - Re-measure the CPU/OpenCL overheads and throughput used by --backend auto\n");
+    printf("  --precision <p>           - Kernel precision: fp64 (default), fp32 (no double at all), or mixed (float integrand, double sums)\n");
+    printf("  --native-math             - With fp32/mixed, use the native_* built-ins for the integrand\n");
+    printf("  --vector-width <w>        - Points per work-item step in fused_integral (1: scalar; default: the device's preferred width)\n");
+    printf("  --trace <file>            - Write every host phase and device command as Chrome trace JSON (also INTEGRAL_TRACE=<file>)\n");
+    printf("  --help                    - Show this help message\n");
+#endif
+}
+
+double exact_integral(double a, double b, int func) {
+    switch (func) {
+        case 0: return -cos(b) + cos(a); // sin(x)
+        case 1: return sin(b) - sin(a);  // cos(x)
+        case 2: return exp(b) - exp(a);  // exp(x)
+        case 3: return (2.0 / 3.0) * (pow(b, 1.5) - pow(a, 1.5)); // sqrt(x)
+        case 4: return b * log(b) - b - (a > 0.0 ? a * log(a) - a : 0.0); // log(x), x log x -> 0 at 0
+        default: return 0.0;
+    }
+}
+
+int consume_flag(int *argc, char *argv[], const char *flag) {
+    for (int i = 1; i < *argc; i++) {
+        if (strcmp(argv[i], flag) == 0) {
+            for (int j = i; j < *argc - 1; j++) {
+                argv[j] = argv[j + 1];
+            }
+            (*argc)--;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char* consume_option(int *argc, char *argv[], const char *option) {
+    for (int i = 1; i < *argc - 1; i++) {
+        if (strcmp(argv[i], option) == 0) {
+            const char *value = argv[i + 1];
+            for (int j = i; j < *argc - 2; j++) {
+                argv[j] = argv[j + 2];
+            }
+            *argc -= 2;
+            return value;
+        }
+    }
+    return NULL;
+}
+
+int parse_backend(const char *name) {
+    if (strcmp(name, "opencl") == 0) {
+        return BACKEND_OPENCL;
+    }
+    if (strcmp(name, "cpu") == 0 || strcmp(name, "sequential") == 0) {
+        return BACKEND_CPU;
+    }
+    if (strcmp(name, "auto") == 0) {
+        return BACKEND_AUTO;
+    }
+    return -1;
+}
+
+int parse_precision(const char *name) {
+    if (strcmp(name, "fp64") == 0) {
+        return PRECISION_FP64;
+    }
+    if (strcmp(name, "fp32") == 0) {
+        return PRECISION_FP32;
+    }
+    if (strcmp(name, "mixed") == 0) {
+        return PRECISION_MIXED;
+    }
+    return -1;
+}
+
+const char* precision_name(int precision) {
+    switch (precision) {
+        case PRECISION_FP32: return "fp32";
+        case PRECISION_MIXED: return "mixed";
+        default: return "fp64";
+    }
+}
+
+// Removes every option it knows from argv. Returns 0, or -1 if an option has
+// an invalid value.
+int parse_options(int *argc, char *argv[], Options *options) {
+    options->compensated = consume_flag(argc, argv, "--compensated");
+
+    const char *chunk_arg = consume_option(argc, argv, "--chunk");
+    options->chunk_size = chunk_arg != NULL ? atoll(chunk_arg) : 0;
+
+    options->expr = consume_option(argc, argv, "--expr");
+
+    const char *replicates_arg = consume_option(argc, argv, "--replicates");
+    options->replicates = replicates_arg != NULL ? atoi(replicates_arg) : DEFAULT_REPLICATES;
+
+    const char *seed_arg = consume_option(argc, argv, "--seed");
+    options->seed = seed_arg != NULL ? strtoull(seed_arg, NULL, 0) : DEFAULT_SEED;
+
+    options->tune = TUNE_AUTO;
+    if (consume_flag(argc, argv, "--no-tune")) {
+        options->tune = TUNE_OFF;
+    }
+    if (consume_flag(argc, argv, "--tune")) {
+        options->tune = TUNE_FORCE;
+    }
+
+    options->multi_device = consume_flag(argc, argv, "--multi");
+    options->cpu_share = consume_flag(argc, argv, "--cpu-share");
+
+    const char *backend_arg = consume_option(argc, argv, "--backend");
+    options->backend = backend_arg != NULL ? parse_backend(backend_arg) : BACKEND_OPENCL;
+    if (options->backend < 0) {
+        fprintf(stderr, "Unknown backend: %s\n", backend_arg);
+        return -1;
+    }
+    options->calibrate = consume_flag(argc, argv, "--calibrate");
+
+    const char *precision_arg = consume_option(argc, argv, "--precision");
+    options->precision = precision_arg != NULL ? parse_precision(precision_arg) : PRECISION_FP64;
+    if (options->precision < 0) {
+        fprintf(stderr, "Unknown precision: %s\n", precision_arg);
+        return -1;
+    }
+    options->native_math = consume_flag(argc, argv, "--native-math");
+    options->trace = consume_option(argc, argv, "--trace");
+
+    const char *vector_arg = consume_option(argc, argv, "--vector-width");
+    options->vector_width = vector_arg != NULL ? atoi(vector_arg) : 0;
+    if (options->vector_width < 0) {
+        fprintf(stderr, "Invalid vector width: %s\n", vector_arg);
+        return -1;
+    }
+    return 0;
+}
+
+void neumaier_add(double *sum, double *comp, double value) {
+    double t = *sum + value;
+    if (fabs(*sum) >= fabs(value)) {
+        *comp += (*sum - t) + value;
+    } else {
+        *comp += (value - t) + *sum;
+    }
+    *sum = t;
+}
+
+int read_params(const char *filename, Params **params) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "File couldn't be opened: %s\n", filename);
+        return -1;
+    }
+
+    int count = 0;
+    int capacity = 128;
+    *params = (Params *)malloc(capacity * sizeof(Params));
+    if (*params == NULL) {
+        fprintf(stderr, "Failed to allocate memory for parameters.\n");
+        fclose(file);
+        return -1;
+    }
+
+    Params row;
+    while (fscanf(file, "%lf %lf %lld %d %d", &row.a, &row.b, &row.n, &row.mode, &row.func) == 5) {
+        if (count == capacity) {
+            Params *grown = (Params *)realloc(*params, 2 * capacity * sizeof(Params));
+            if (grown == NULL) {
+                fprintf(stderr, "Failed to allocate memory for parameters.\n");
+                free(*params);
+                *params = NULL;
+                fclose(file);
+                return -1;
+            }
+            *params = grown;
+            capacity *= 2;
+        }
+        (*params)[count++] = row;
+    }
+
+    fclose(file);
+    return count;
+}
+
+double rule_factor(int mode, double h) {
+    switch (mode) {
+        case 0: return h / 3.0;
+        case 1: return h;
+        default: return h / 2.0;
+    }
+}
+
+void least_squares(double *x, double *y, int n, double *a, double *b) {
+    double sum_x = 0.0, sum_y = 0.0, sum_xx = 0.0, sum_xy = 0.0;
+    for (int i = 0; i < n; i++) {
+        sum_x += x[i];
+        sum_y += y[i];
+        sum_xx += x[i] * x[i];
+        sum_xy += x[i] * y[i];
+    }
+    *a = (n * sum_xy - sum_x * sum_y) / (n * sum_xx - sum_x * sum_x);
+    *b = (sum_y - (*a) * sum_x) / n;
+}
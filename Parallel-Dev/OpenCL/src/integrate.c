@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "integrate.h"
+#include "input_utils.h"
+#include "cpu_utils.h"
+#include "expr_utils.h"
+#ifndef INTEGRATE_CPU_ONLY
+#include "opencl_utils.h"
+#include "batch_utils.h"
+#include "dispatch_utils.h"
+#include "trace_utils.h"
+#endif
+
+// Built with -DINTEGRATE_CPU_ONLY (as the sequential program does) the
+// library has no OpenCL dependency and every call runs on the CPU backend.
+
+struct IntegrateContext {
+    Options options;
+    const char *kernel_file;
+    CompiledExpression compiled;
+    int compiled_ready;
+#ifndef INTEGRATE_CPU_ONLY
+    OpenCLEngine engine;
+    int engine_ready;
+#endif
+};
+
+void integrate_default_config(IntegrateConfig *config) {
+    config->backend = INTEGRATE_BACKEND_OPENCL;
+    config->kernel_file = NULL;
+    config->expr = NULL;
+    config->compensated = 0;
+    config->chunk_size = 0;
+    config->precision = INTEGRATE_PRECISION_FP64;
+    config->native_math = 0;
+    config->tune = TUNE_AUTO;
+    config->calibrate = 0;
+}
+
+IntegrateContext* integrate_create(const IntegrateConfig *config) {
+    if (config->backend < INTEGRATE_BACKEND_OPENCL || config->backend > INTEGRATE_BACKEND_AUTO) {
+        fprintf(stderr, "Unknown backend: %d\n", config->backend);
+        return NULL;
+    }
+    if (config->precision < INTEGRATE_PRECISION_FP64 || config->precision > INTEGRATE_PRECISION_MIXED) {
+        fprintf(stderr, "Unknown precision: %d\n", config->precision);
+        return NULL;
+    }
+#ifdef INTEGRATE_CPU_ONLY
+    if (config->backend == INTEGRATE_BACKEND_OPENCL) {
+        fprintf(stderr, "This build of libintegrate has no OpenCL backend.\n");
+        return NULL;
+    }
+#endif
+
+    // Syntax errors surface here; the expression is only compiled for a
+    // backend the first time that backend runs it.
+    if (config->expr != NULL) {
+        char code[MAX_EXPR_CODE];
+        char message[256];
+        if (expr_to_code(config->expr, code, sizeof(code), message, sizeof(message)) != 0) {
+            fprintf(stderr, "Invalid expression \"%s\": %s\n", config->expr, message);
+            return NULL;
+        }
+    }
+
+    IntegrateContext *context = (IntegrateContext *)calloc(1, sizeof(IntegrateContext));
+    if (context == NULL) {
+        fprintf(stderr, "Failed to allocate integration context.\n");
+        return NULL;
+    }
+
+    Options *options = &context->options;
+    options->compensated = config->compensated;
+    options->chunk_size = config->chunk_size;
+    options->expr = config->expr;
+    options->replicates = DEFAULT_REPLICATES;
+    options->seed = DEFAULT_SEED;
+    options->tune = config->tune;
+    options->backend = config->backend;
+    options->calibrate = config->calibrate;
+    options->precision = config->precision;
+    options->native_math = config->native_math;
+    context->kernel_file = config->kernel_file;
+#ifndef INTEGRATE_CPU_ONLY
+    trace_open(NULL);   // embedders enable tracing through the environment
+#endif
+
+    return context;
+}
+
+void integrate_destroy(IntegrateContext *context) {
+    if (context == NULL) {
+        return;
+    }
+    if (context->compiled_ready) {
+        release_expression(&context->compiled);
+    }
+#ifndef INTEGRATE_CPU_ONLY
+    if (context->engine_ready) {
+        engine_destroy(&context->engine);
+    }
+#endif
+    free(context);
+}
+
+static int check_job(const IntegrateJob *job) {
+    if (job->n <= 0 || job->mode < INTEGRATE_MODE_SIMPSON || job->mode > INTEGRATE_MODE_TRAPEZOIDAL) {
+        fprintf(stderr, "Invalid job: expected n > 0 and mode 0-2.\n");
+        return -1;
+    }
+    return 0;
+}
+
+// The expression is compiled for the CPU the first time it is needed there.
+static const CompiledExpression* cpu_expression(IntegrateContext *context) {
+    if (context->options.expr == NULL) {
+        return NULL;
+    }
+    if (!context->compiled_ready) {
+        if (compile_expression(context->options.expr, &context->compiled) != 0) {
+            return NULL;
+        }
+        context->compiled_ready = 1;
+    }
+    return &context->compiled;
+}
+
+#ifndef INTEGRATE_CPU_ONLY
+// NULL if the engine cannot be created; the next call tries again.
+static OpenCLEngine* context_engine(IntegrateContext *context) {
+    if (!context->engine_ready) {
+        if (engine_init_options(&context->engine, context->kernel_file != NULL ? context->kernel_file : KERNEL_FILE, &context->options) != 0) {
+            return NULL;
+        }
+        context->engine_ready = 1;
+    }
+    return &context->engine;
+}
+
+// Once this context holds a warm engine, the auto backend no longer charges
+// the OpenCL setup cost.
+static int context_backend(IntegrateContext *context, int jobs, long long points) {
+    if (context->options.backend != BACKEND_AUTO) {
+        return context->options.backend;
+    }
+
+    DispatchModel model;
+    get_dispatch_model(&model, &context->options);
+    if (context->engine_ready) {
+        model.opencl_overhead = 0.0;
+    }
+    return choose_backend(&model, jobs, points);
+}
+#else
+static int context_backend(IntegrateContext *context, int jobs, long long points) {
+    return BACKEND_CPU;
+}
+#endif
+
+int integrate_run(IntegrateContext *context, const IntegrateJob *job, double *result, IntegrateStats *stats) {
+    return integrate_batch(context, job, 1, result, stats);
+}
+
+int integrate_batch(IntegrateContext *context, const IntegrateJob *jobs, int count, double *results, IntegrateStats *stats) {
+    if (count <= 0) {
+        fprintf(stderr, "Invalid batch: no jobs.\n");
+        return -1;
+    }
+
+    long long total_points = 0;
+    for (int i = 0; i < count; i++) {
+        if (check_job(&jobs[i]) != 0) {
+            return -1;
+        }
+        total_points += jobs[i].n + 1;
+    }
+
+    double elapsed_time = 0.0;
+    int backend = context_backend(context, count, total_points);
+#ifndef INTEGRATE_CPU_ONLY
+    if (backend == BACKEND_OPENCL && context_engine(context) == NULL) {
+        if (context->options.backend != BACKEND_AUTO) {
+            return -1;
+        }
+        backend = BACKEND_CPU;     // auto: OpenCL is unavailable
+    }
+#endif
+
+    if (backend == BACKEND_CPU) {
+        const CompiledExpression *compiled = cpu_expression(context);
+        if (context->options.expr != NULL && compiled == NULL) {
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            double job_time;
+            if (run_cpu(compiled, jobs[i].a, jobs[i].b, jobs[i].n, jobs[i].mode, jobs[i].func, &results[i], &job_time) != 0) {
+                return -1;
+            }
+            elapsed_time += job_time;
+        }
+    }
+#ifndef INTEGRATE_CPU_ONLY
+    else if (count == 1) {
+        double exact_value, error;
+        if (run_algorithm(&context->engine, jobs[0].a, jobs[0].b, jobs[0].n, jobs[0].mode, jobs[0].func, &results[0], &exact_value, &error, &elapsed_time) != 0) {
+            return -1;
+        }
+    } else {
+        Params *params = (Params *)malloc(count * sizeof(Params));
+        if (params == NULL) {
+            fprintf(stderr, "Failed to allocate batch parameters.\n");
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            params[i].a = jobs[i].a;
+            params[i].b = jobs[i].b;
+            params[i].n = jobs[i].n;
+            params[i].mode = jobs[i].mode;
+            params[i].func = jobs[i].func;
+        }
+        int status = run_batch(&context->engine, params, count, results, &elapsed_time);
+        free(params);
+        if (status != 0) {
+            return -1;
+        }
+    }
+#endif
+
+    if (stats != NULL) {
+        stats->elapsed_time = elapsed_time;
+        stats->backend = backend;
+    }
+    return 0;
+}
+
+double integrate_exact(double a, double b, int func) {
+    return exact_integral(a, b, func);
+}
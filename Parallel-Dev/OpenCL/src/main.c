@@ -1,100 +1,555 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <math.h>
-#include <CL/cl.h>
-#include <string.h>
-#include "opencl_utils.h"
-#include "input_utils.h"
-#include "time_utils.h"
-
-#define MAX_SIZE_VALUES 100
-
-int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        print_usage(argv[0]);
-        return 1;
-    }
-
-    if (argc == 2 && (strcmp(argv[1], "help") == 0 || strcmp(argv[1], "--help") == 0)) {
-        print_help(argv[0]);
-        return 0;
-    }
-
-    if (argc == 3 && strcmp(argv[1], "--complexity") == 0) {
-        Params params[MAX_SIZE_VALUES];
-        int count = read_params(argv[2], params);
-        if (count == -1) {
-            return 1;
-        }
-
-        double *sizes = (double *)malloc(count * sizeof(double));
-        double *times = (double *)malloc(count * sizeof(double));
-
-        for (int i = 0; i < count; i++) {
-            double final_result, exact_value, error;
-            double elapsed_time = run_algorithm(params[i].a, params[i].b, params[i].n, params[i].mode, params[i].func, &final_result, &exact_value, &error);
-
-            sizes[i] = log10((double)params[i].n);
-            times[i] = log10(elapsed_time);
-
-           // printf("n = %d, elapsed_time = %.10f\n", params[i].n, elapsed_time);
-        }
-
-        double a, b;
-        least_squares(sizes, times, count, &a, &b);
-        printf("Time complexity: O(n^%.2f)\n", a);
-
-        free(sizes);
-        free(times);
-        return 0;
-    }
-
-    if (argc >= 7 && strcmp(argv[1], "--simpson") == 0) {
-        int dim = atoi(argv[2]);
-        if (argc != 3 + 3 * dim + 1) {
-            fprintf(stderr, "Wrong number of arguments.\n");
-            return 1;
-        }
-
-        double lower[dim];
-        double upper[dim];
-        int n[dim];
-
-        int index = 3;
-        for (int i = 0; i < dim; i++) {
-            lower[i] = atof(argv[index]);
-            upper[i] = atof(argv[index + 1]);
-            n[i] = atoi(argv[index + 2]);
-            index += 3;
-        }
-        int func = atoi(argv[index]);
-
-        double result;
-        double elapsed_time = run_simpson_nd(lower, upper, n, dim, func, &result);
-
-        printf("Value of the integral: %.10f\n", result);
-        printf("Elapsed time: %.10f seconds\n", elapsed_time);
-        return 0;
-    }
-
-    if (argc != 6) {
-        print_usage(argv[0]);
-        return 1;
-    }
-
-    double a = atof(argv[1]);
-    double b = atof(argv[2]);
-    int size = atoi(argv[3]);
-    int mode = atoi(argv[4]);
-    int func = atoi(argv[5]);
-
-    double final_result, exact_value, error;
-    double elapsed_time = run_algorithm(a, b, size, mode, func, &final_result, &exact_value, &error);
-
-    printf("Value of the integral: %.10f\n", final_result);
-    printf("Exact value of the integral: %.10f\n", exact_value);
-    printf("Approximation error: %.10f\n", error);
-    printf("Elapsed time: %.10f seconds\n", elapsed_time);
-
-    return 0;
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <CL/cl.h>
+#include <string.h>
+#include "opencl_utils.h"
+#include "input_utils.h"
+#include "time_utils.h"
+#include "adaptive_utils.h"
+#include "romberg_utils.h"
+#include "tanh_sinh_utils.h"
+#include "gauss_utils.h"
+#include "sweep_utils.h"
+#include "sample_utils.h"
+#include "serve_utils.h"
+#include "async_utils.h"
+#include "qmc_utils.h"
+#include "bench_utils.h"
+#include "multi_utils.h"
+#include "cpu_utils.h"
+#include "integrate.h"
+#include "trace_utils.h"
+
+// The single-integral and batch paths go through libintegrate, like any
+// embedding program would.
+static IntegrateContext* create_context(const Options *options) {
+    IntegrateConfig config;
+    integrate_default_config(&config);
+    config.backend = options->backend;
+    config.expr = options->expr;
+    config.compensated = options->compensated;
+    config.chunk_size = options->chunk_size;
+    config.precision = options->precision;
+    config.native_math = options->native_math;
+    config.tune = options->tune;
+    config.calibrate = options->calibrate;
+    return integrate_create(&config);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    if (argc == 2 && (strcmp(argv[1], "help") == 0 || strcmp(argv[1], "--help") == 0)) {
+        print_help(argv[0]);
+        return 0;
+    }
+
+    Options options;
+    if (parse_options(&argc, argv, &options) != 0) {
+        return 1;
+    }
+    trace_open(options.trace);
+
+    if (argc == 3 && strcmp(argv[1], "--complexity") == 0) {
+        Params *params;
+        int count = read_params(argv[2], &params);
+        if (count == -1) {
+            return 1;
+        }
+
+        OpenCLEngine engine;
+        if (engine_init_options(&engine, KERNEL_FILE, &options) != 0) {
+            return 1;
+        }
+
+        double *sizes = (double *)malloc(count * sizeof(double));
+        double *times = (double *)malloc(count * sizeof(double));
+        int failed = sizes == NULL || times == NULL;
+
+        // One size at a time: each future is awaited before the next one is
+        // submitted, so no two sizes share the device and every time is
+        // measured alone. With --chunk each size is streamed through
+        // run_algorithm instead.
+        for (int i = 0; i < count && !failed; i++) {
+            double elapsed_time, result;
+            if (engine.chunk_size > 0) {
+                double exact_value, error;
+                failed = run_algorithm(&engine, params[i].a, params[i].b, params[i].n, params[i].mode, params[i].func, &result, &exact_value, &error, &elapsed_time) != 0;
+            } else {
+                IntegralFuture *future = integrate_async(&engine, params[i].a, params[i].b, params[i].n, params[i].mode, params[i].func, NULL, NULL);
+                failed = future == NULL || future_get(future, &result, &elapsed_time) != 0;
+            }
+            if (failed) {
+                break;
+            }
+
+            sizes[i] = log10((double)params[i].n);
+            times[i] = log10(elapsed_time);
+
+           // printf("n = %lld, elapsed_time = %.10f\n", params[i].n, elapsed_time);
+        }
+        if (failed) {
+            engine_destroy(&engine);
+            free(params);
+            free(sizes);
+            free(times);
+            return 1;
+        }
+
+        double a, b;
+        least_squares(sizes, times, count, &a, &b);
+        printf("Time complexity: O(n^%.2f)\n", a);
+
+        engine_destroy(&engine);
+        free(params);
+        free(sizes);
+        free(times);
+        return 0;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--bench") == 0) {
+        BenchSpec spec;
+        if (read_bench_spec(argv[2], &spec) != 0) {
+            return 1;
+        }
+        return run_bench(&spec, &options, stdout) == 0 ? 0 : 1;
+    }
+
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "--serve") == 0) {
+        OpenCLEngine engine;
+        if (engine_init_options(&engine, KERNEL_FILE, &options) != 0) {
+            return 1;
+        }
+
+        int status = run_server(&engine, &options, argc == 3 ? argv[2] : NULL);
+
+        engine_destroy(&engine);
+        return status == 0 ? 0 : 1;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "--batch") == 0) {
+        Params *params;
+        int count = read_params(argv[2], &params);
+        if (count == -1) {
+            return 1;
+        }
+        if (count == 0) {
+            free(params);
+            return 1;
+        }
+
+        IntegrateContext *context = create_context(&options);
+        IntegrateJob *jobs = (IntegrateJob *)malloc(count * sizeof(IntegrateJob));
+        double *results = (double *)malloc(count * sizeof(double));
+        IntegrateStats stats;
+        int failed = context == NULL || jobs == NULL || results == NULL;
+        if (!failed) {
+            for (int i = 0; i < count; i++) {
+                jobs[i].a = params[i].a;
+                jobs[i].b = params[i].b;
+                jobs[i].n = params[i].n;
+                jobs[i].mode = params[i].mode;
+                jobs[i].func = params[i].func;
+            }
+            failed = integrate_batch(context, jobs, count, results, &stats) != 0;
+        }
+        if (failed) {
+            integrate_destroy(context);
+            free(params);
+            free(jobs);
+            free(results);
+            return 1;
+        }
+
+        for (int i = 0; i < count; i++) {
+            printf("%g %g %lld %d %d: %.10f", params[i].a, params[i].b, params[i].n, params[i].mode, params[i].func, results[i]);
+            if (options.expr == NULL) {
+                double exact_value = integrate_exact(params[i].a, params[i].b, params[i].func);
+                printf(" (error %.10f)", fabs(results[i] - exact_value));
+            }
+            printf("\n");
+        }
+        if (options.backend == BACKEND_AUTO) {
+            printf("Backend: %s\n", stats.backend == BACKEND_CPU ? "cpu" : "opencl");
+        }
+        printf("Elapsed time: %.10f seconds\n", stats.elapsed_time);
+
+        integrate_destroy(context);
+        free(params);
+        free(jobs);
+        free(results);
+        return 0;
+    }
+
+    if ((argc == 8 || (argc == 7 && options.expr != NULL)) && strcmp(argv[1], "--sweep") == 0) {
+        double *values;
+        int count = read_sweep_values(argv[2], &values);
+        if (count <= 0) {
+            return 1;
+        }
+        double a = atof(argv[3]);
+        double b = atof(argv[4]);
+        long long n = atoll(argv[5]);
+        int mode = atoi(argv[6]);
+        int func = argc == 8 ? atoi(argv[7]) : 0;
+
+        OpenCLEngine engine;
+        if (engine_init_options(&engine, KERNEL_FILE, &options) != 0) {
+            free(values);
+            return 1;
+        }
+
+        double *results = (double *)malloc(count * sizeof(double));
+        double elapsed_time;
+        if (results == NULL || run_sweep(&engine, a, b, n, mode, func, values, count, results, &elapsed_time) != 0) {
+            engine_destroy(&engine);
+            free(values);
+            free(results);
+            return 1;
+        }
+
+        for (int i = 0; i < count; i++) {
+            printf("%g: %.10f", values[i], results[i]);
+            if (options.expr == NULL && (values[i] != 0.0 || func != 4)) {
+                printf(" (error %.10f)", fabs(results[i] - sweep_exact(a, b, values[i], func)));
+            }
+            printf("\n");
+        }
+        printf("Elapsed time: %.10f seconds\n", elapsed_time);
+
+        engine_destroy(&engine);
+        free(values);
+        free(results);
+        return 0;
+    }
+
+    if ((argc == 4 || argc == 6) && strcmp(argv[1], "--samples") == 0) {
+        SampleFile file;
+        if (open_samples(argv[2], &file) != 0) {
+            return 1;
+        }
+
+        int mode = atoi(argv[3]);
+        double a = argc == 6 ? atof(argv[4]) : file.a;
+        double b = argc == 6 ? atof(argv[5]) : file.b;
+        if (argc == 4 && !file.has_range) {
+            fprintf(stderr, "%s has no header; give <a> <b> on the command line.\n", argv[2]);
+            close_samples(&file);
+            return 1;
+        }
+
+        OpenCLEngine engine;
+        if (engine_init_options(&engine, KERNEL_FILE, &options) != 0) {
+            close_samples(&file);
+            return 1;
+        }
+
+        double final_result, elapsed_time;
+        if (run_samples(&engine, &file, a, b, mode, &final_result, &elapsed_time) != 0) {
+            engine_destroy(&engine);
+            close_samples(&file);
+            return 1;
+        }
+
+        printf("Value of the integral: %.10f\n", final_result);
+        printf("Samples: %lld\n", file.count);
+        printf("Elapsed time: %.10f seconds\n", elapsed_time);
+
+        engine_destroy(&engine);
+        close_samples(&file);
+        return 0;
+    }
+
+    if ((argc == 6 || (argc == 5 && options.expr != NULL)) && strcmp(argv[1], "--adaptive") == 0) {
+        double a = atof(argv[2]);
+        double b = atof(argv[3]);
+        double tolerance = atof(argv[4]);
+        int func = argc == 6 ? atoi(argv[5]) : 0;
+
+        OpenCLEngine engine;
+        if (engine_init_options(&engine, KERNEL_FILE, &options) != 0) {
+            return 1;
+        }
+
+        double final_result, exact_value, error, elapsed_time;
+        long long evaluations;
+        if (run_adaptive(&engine, a, b, tolerance, func, &final_result, &exact_value, &error, &evaluations, &elapsed_time) != 0) {
+            engine_destroy(&engine);
+            return 1;
+        }
+
+        printf("Value of the integral: %.10f\n", final_result);
+        if (options.expr == NULL) {
+            printf("Exact value of the integral: %.10f\n", exact_value);
+            printf("Approximation error: %.10e\n", error);
+        }
+        printf("Function evaluations: %lld\n", evaluations);
+        printf("Elapsed time: %.10f seconds\n", elapsed_time);
+
+        engine_destroy(&engine);
+        return 0;
+    }
+
+    if ((argc == 6 || (argc == 5 && options.expr != NULL)) && strcmp(argv[1], "--romberg") == 0) {
+        double a = atof(argv[2]);
+        double b = atof(argv[3]);
+        double tolerance = atof(argv[4]);
+        int func = argc == 6 ? atoi(argv[5]) : 0;
+
+        OpenCLEngine engine;
+        if (engine_init_options(&engine, KERNEL_FILE, &options) != 0) {
+            return 1;
+        }
+
+        double final_result, exact_value, error, elapsed_time;
+        long long evaluations;
+        int levels;
+        if (run_romberg(&engine, a, b, tolerance, func, &final_result, &exact_value, &error, &evaluations, &levels, &elapsed_time) != 0) {
+            engine_destroy(&engine);
+            return 1;
+        }
+
+        printf("Value of the integral: %.10f\n", final_result);
+        if (options.expr == NULL) {
+            printf("Exact value of the integral: %.10f\n", exact_value);
+            printf("Approximation error: %.10e\n", error);
+        }
+        printf("Levels: %d\n", levels);
+        printf("Function evaluations: %lld\n", evaluations);
+        printf("Elapsed time: %.10f seconds\n", elapsed_time);
+
+        engine_destroy(&engine);
+        return 0;
+    }
+
+    if ((argc == 6 || (argc == 5 && options.expr != NULL)) && strcmp(argv[1], "--tanh-sinh") == 0) {
+        double a = atof(argv[2]);
+        double b = atof(argv[3]);
+        double tolerance = atof(argv[4]);
+        int func = argc == 6 ? atoi(argv[5]) : 0;
+
+        OpenCLEngine engine;
+        if (engine_init_options(&engine, KERNEL_FILE, &options) != 0) {
+            return 1;
+        }
+
+        double final_result, exact_value, error, elapsed_time;
+        long long evaluations;
+        int levels;
+        if (run_tanh_sinh(&engine, a, b, tolerance, func, &final_result, &exact_value, &error, &evaluations, &levels, &elapsed_time) != 0) {
+            engine_destroy(&engine);
+            return 1;
+        }
+
+        printf("Value of the integral: %.10f\n", final_result);
+        if (options.expr == NULL) {
+            printf("Exact value of the integral: %.10f\n", exact_value);
+            printf("Approximation error: %.10e\n", error);
+        }
+        printf("Levels: %d\n", levels);
+        printf("Function evaluations: %lld\n", evaluations);
+        printf("Elapsed time: %.10f seconds\n", elapsed_time);
+
+        engine_destroy(&engine);
+        return 0;
+    }
+
+    if ((argc == 7 || (argc == 6 && options.expr != NULL)) && strcmp(argv[1], "--gauss") == 0) {
+        int order = atoi(argv[2]);
+        double a = atof(argv[3]);
+        double b = atof(argv[4]);
+        long long panels = atoll(argv[5]);
+        int func = argc == 7 ? atoi(argv[6]) : 0;
+
+        OpenCLEngine engine;
+        if (engine_init_options(&engine, KERNEL_FILE, &options) != 0) {
+            return 1;
+        }
+
+        double final_result, exact_value, error, elapsed_time;
+        if (run_gauss_legendre(&engine, a, b, panels, order, func, &final_result, &exact_value, &error, &elapsed_time) != 0) {
+            engine_destroy(&engine);
+            return 1;
+        }
+
+        printf("Value of the integral: %.10f\n", final_result);
+        if (options.expr == NULL) {
+            printf("Exact value of the integral: %.10f\n", exact_value);
+            printf("Approximation error: %.10e\n", error);
+        }
+        printf("Function evaluations: %lld\n", panels * order);
+        printf("Elapsed time: %.10f seconds\n", elapsed_time);
+
+        engine_destroy(&engine);
+        return 0;
+    }
+
+    if (argc >= 7 && strcmp(argv[1], "--simpson") == 0) {
+        int dim = atoi(argv[2]);
+        if (argc != 3 + 3 * dim + 1) {
+            fprintf(stderr, "Wrong number of arguments.\n");
+            return 1;
+        }
+
+        if (dim < 1 || dim > MAX_DIM) {
+            fprintf(stderr, "Dimension must be between 1 and %d.\n", MAX_DIM);
+            return 1;
+        }
+
+        double lower[dim];
+        double upper[dim];
+        long long n[dim];
+
+        int index = 3;
+        for (int i = 0; i < dim; i++) {
+            lower[i] = atof(argv[index]);
+            upper[i] = atof(argv[index + 1]);
+            n[i] = atoll(argv[index + 2]);
+            index += 3;
+        }
+        int func = atoi(argv[index]);
+
+        OpenCLEngine engine;
+        if (engine_init_options(&engine, KERNEL_FILE, &options) != 0) {
+            return 1;
+        }
+
+        double result, elapsed_time;
+        int status = run_simpson_nd(&engine, lower, upper, n, dim, func, &result, &elapsed_time);
+        if (status != 0) {
+            engine_destroy(&engine);
+            return 1;
+        }
+
+        printf("Value of the integral: %.10f\n", result);
+        printf("Elapsed time: %.10f seconds\n", elapsed_time);
+
+        engine_destroy(&engine);
+        return 0;
+    }
+
+    if (argc >= 7 && (strcmp(argv[1], "--qmc") == 0 || strcmp(argv[1], "--mc") == 0)) {
+        int dim = atoi(argv[2]);
+        if (dim < 1 || dim > MAX_DIM || argc != 3 + 2 * dim + 2) {
+            fprintf(stderr, "Wrong number of arguments.\n");
+            return 1;
+        }
+
+        double lower[dim];
+        double upper[dim];
+
+        int index = 3;
+        for (int i = 0; i < dim; i++) {
+            lower[i] = atof(argv[index]);
+            upper[i] = atof(argv[index + 1]);
+            index += 2;
+        }
+        long long samples = atoll(argv[index]);
+        int func = atoi(argv[index + 1]);
+        int sequence = strcmp(argv[1], "--qmc") == 0 ? QMC_HALTON : QMC_RANDOM;
+
+        OpenCLEngine engine;
+        if (engine_init_options(&engine, KERNEL_FILE, &options) != 0) {
+            return 1;
+        }
+
+        double result, std_error, elapsed_time;
+        if (run_qmc(&engine, lower, upper, dim, samples, func, sequence, options.replicates, options.seed, &result, &std_error, &elapsed_time) != 0) {
+            engine_destroy(&engine);
+            return 1;
+        }
+
+        printf("Value of the integral: %.10f\n", result);
+        printf("Estimated error (%d replicates): %.10e\n", options.replicates, std_error);
+        printf("Elapsed time: %.10f seconds\n", elapsed_time);
+
+        engine_destroy(&engine);
+        return 0;
+    }
+
+    if (argc != 6 && !(argc == 5 && options.expr != NULL)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    double a = atof(argv[1]);
+    double b = atof(argv[2]);
+    long long size = atoll(argv[3]);
+    int mode = atoi(argv[4]);
+    int func = argc == 6 ? atoi(argv[5]) : 0;
+
+    if (options.multi_device) {
+        MultiWorker *workers;
+        int worker_count = multi_init(&workers, KERNEL_FILE, &options);
+        if (worker_count < 0) {
+            return 1;
+        }
+
+        CompiledExpression compiled;
+        const CompiledExpression *cpu_expr = NULL;
+        if (options.expr != NULL && options.cpu_share) {
+            if (compile_expression(options.expr, &compiled) != 0) {
+                multi_destroy(workers, worker_count);
+                return 1;
+            }
+            cpu_expr = &compiled;
+        }
+
+        double final_result, elapsed_time;
+        if (run_multi(workers, worker_count, cpu_expr, a, b, size, mode, func, options.chunk_size, &final_result, &elapsed_time) != 0) {
+            if (cpu_expr != NULL) {
+                release_expression(&compiled);
+            }
+            multi_destroy(workers, worker_count);
+            return 1;
+        }
+
+        printf("Value of the integral: %.10f\n", final_result);
+        if (options.expr == NULL) {
+            double exact_value = exact_integral(a, b, func);
+            printf("Exact value of the integral: %.10f\n", exact_value);
+            printf("Approximation error: %.10f\n", fabs(final_result - exact_value));
+        }
+        for (int i = 0; i < worker_count; i++) {
+            printf("Worker %d (%s): %.3e points/s, %lld chunks, %lld stolen%s\n", i, workers[i].name, workers[i].throughput, workers[i].chunks_done, workers[i].chunks_stolen,
+                   workers[i].failed ? ", failed" : "");
+        }
+        printf("Elapsed time: %.10f seconds\n", elapsed_time);
+
+        if (cpu_expr != NULL) {
+            release_expression(&compiled);
+        }
+        multi_destroy(workers, worker_count);
+        return 0;
+    }
+
+    IntegrateContext *context = create_context(&options);
+    if (context == NULL) {
+        return 1;
+    }
+
+    IntegrateJob job = { a, b, size, mode, func };
+    double final_result;
+    IntegrateStats stats;
+    if (integrate_run(context, &job, &final_result, &stats) != 0) {
+        return 1;
+    }
+
+    printf("Value of the integral: %.10f\n", final_result);
+    if (options.expr == NULL) {
+        double exact_value = integrate_exact(a, b, func);
+        printf("Exact value of the integral: %.10f\n", exact_value);
+        printf("Approximation error: %.10f\n", fabs(final_result - exact_value));
+    }
+    if (stats.backend == BACKEND_CPU || options.backend == BACKEND_AUTO) {
+        printf("Backend: %s\n", stats.backend == BACKEND_CPU ? "cpu" : "opencl");
+    }
+    printf("Elapsed time: %.10f seconds\n", stats.elapsed_time);
+
+    integrate_destroy(context);
+    return 0;
 }
\ No newline at end of file
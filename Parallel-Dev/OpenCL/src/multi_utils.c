@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <CL/cl.h>
+#include "multi_utils.h"
+#include "opencl_utils.h"
+#include "cpu_utils.h"
+#include "input_utils.h"
+#include "time_utils.h"
+
+typedef struct {
+    MultiWorker *workers;
+    int count;
+    pthread_mutex_t lock;
+    long long orphans[MAX_DEVICES + 1];     // chunks of failed launches, handed out first
+    int orphan_count;
+    const CompiledExpression *compiled;
+    double a;
+    double h;
+    long long size;
+    long long points;
+    long long chunk_points;
+    int mode;
+    int func;
+} MultiRun;
+
+typedef struct {
+    MultiRun *run;
+    int index;
+} MultiThread;
+
+// Every device of every platform gets its own engine (context, queue and
+// program); --cpu-share adds a worker that runs on the host cores. A device
+// whose engine cannot be created is skipped. Returns the worker count, or -1
+// if there is no usable worker or an allocation fails.
+int multi_init(MultiWorker **workers, const char *kernel_file, const Options *options) {
+    cl_platform_id platforms[MAX_DEVICES];
+    cl_uint num_platforms = 0;
+    cl_int ret = clGetPlatformIDs(MAX_DEVICES, platforms, &num_platforms);
+    if (ret != CL_SUCCESS || num_platforms == 0) {
+        fprintf(stderr, "No OpenCL platform found. Error: %d\n", ret);
+        return -1;
+    }
+    if (num_platforms > MAX_DEVICES) {
+        num_platforms = MAX_DEVICES;
+    }
+
+    *workers = (MultiWorker *)calloc(MAX_DEVICES + 1, sizeof(MultiWorker));
+    if (*workers == NULL) {
+        fprintf(stderr, "Failed to allocate workers.\n");
+        return -1;
+    }
+
+    int count = 0;
+    for (cl_uint p = 0; p < num_platforms && count < MAX_DEVICES; p++) {
+        cl_device_id devices[MAX_DEVICES];
+        cl_uint num_devices = 0;
+        if (clGetDeviceIDs(platforms[p], CL_DEVICE_TYPE_ALL, MAX_DEVICES, devices, &num_devices) != CL_SUCCESS) {
+            continue;
+        }
+        if (num_devices > MAX_DEVICES) {
+            num_devices = MAX_DEVICES;
+        }
+
+        for (cl_uint d = 0; d < num_devices && count < MAX_DEVICES; d++) {
+            MultiWorker *worker = &(*workers)[count];
+            worker->engine = (OpenCLEngine *)malloc(sizeof(OpenCLEngine));
+            if (worker->engine == NULL) {
+                fprintf(stderr, "Failed to allocate engine.\n");
+                multi_destroy(*workers, count);
+                return -1;
+            }
+            clGetDeviceInfo(devices[d], CL_DEVICE_NAME, sizeof(worker->name), worker->name, NULL);
+            if (engine_init_device(worker->engine, platforms[p], devices[d], kernel_file, options) != 0) {
+                fprintf(stderr, "Skipping device %s.\n", worker->name);
+                free(worker->engine);
+                worker->engine = NULL;
+                continue;
+            }
+            count++;
+        }
+    }
+
+    if (options->cpu_share) {
+        MultiWorker *worker = &(*workers)[count++];
+        worker->engine = NULL;
+        snprintf(worker->name, sizeof(worker->name), "CPU backend");
+    }
+
+    if (count == 0) {
+        fprintf(stderr, "No OpenCL device found.\n");
+        free(*workers);
+        return -1;
+    }
+
+    return count;
+}
+
+void multi_destroy(MultiWorker *workers, int count) {
+    for (int i = 0; i < count; i++) {
+        if (workers[i].engine != NULL) {
+            engine_destroy(workers[i].engine);
+            free(workers[i].engine);
+        }
+    }
+    free(workers);
+}
+
+// Sums [start, end) on the worker. On failure the worker is marked failed
+// and gives up; returns -1.
+static int worker_range_sum(MultiRun *run, MultiWorker *worker, long long start, long long end, double *sum) {
+    if (worker->engine == NULL) {
+        *sum = weighted_range_sum(run->a, run->h, start, end, run->size, run->mode, run->func, run->compiled);
+        return 0;
+    }
+
+    double kernel_time;
+    if (fused_range_sum(worker->engine, run->a, run->h, start, end, run->size, run->mode, run->func, sum, &kernel_time) != 0) {
+        fprintf(stderr, "Worker %s failed; the others take over its chunks.\n", worker->name);
+        worker->failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+// Hands a chunk the worker could not sum to whoever asks next.
+static void orphan_chunk(MultiRun *run, long long chunk) {
+    pthread_mutex_lock(&run->lock);
+    run->orphans[run->orphan_count++] = chunk;
+    pthread_mutex_unlock(&run->lock);
+}
+
+// Chunks that no running worker will sum: orphans, and what is left of the
+// ranges (a failed worker's range stays there until stolen).
+static long long chunks_left(MultiRun *run) {
+    long long left = run->orphan_count;
+    for (int i = 0; i < run->count; i++) {
+        left += run->workers[i].end_chunk - run->workers[i].next_chunk;
+    }
+    return left;
+}
+
+// Takes an orphaned chunk, the next chunk of the worker's own range, or
+// steals the back half of the largest range left on another worker.
+// Returns -1 when all are done.
+static long long next_chunk(MultiRun *run, int index) {
+    MultiWorker *self = &run->workers[index];
+    long long chunk = -1;
+
+    pthread_mutex_lock(&run->lock);
+    if (run->orphan_count > 0) {
+        chunk = run->orphans[--run->orphan_count];
+        pthread_mutex_unlock(&run->lock);
+        return chunk;
+    }
+    if (self->next_chunk >= self->end_chunk) {
+        MultiWorker *victim = NULL;
+        for (int i = 0; i < run->count; i++) {
+            MultiWorker *other = &run->workers[i];
+            long long remaining = other->end_chunk - other->next_chunk;
+            if (remaining > 0 && (victim == NULL || remaining > victim->end_chunk - victim->next_chunk)) {
+                victim = other;
+            }
+        }
+        if (victim != NULL) {
+            long long take = (victim->end_chunk - victim->next_chunk + 1) / 2;
+            self->next_chunk = victim->end_chunk - take;
+            self->end_chunk = victim->end_chunk;
+            victim->end_chunk -= take;
+            self->chunks_stolen += take;
+        }
+    }
+    if (self->next_chunk < self->end_chunk) {
+        chunk = self->next_chunk++;
+    }
+    pthread_mutex_unlock(&run->lock);
+
+    return chunk;
+}
+
+static void *multi_worker_main(void *arg) {
+    MultiThread *thread = (MultiThread *)arg;
+    MultiRun *run = thread->run;
+    MultiWorker *worker = &run->workers[thread->index];
+
+    long long chunk;
+    while (!worker->failed && (chunk = next_chunk(run, thread->index)) >= 0) {
+        long long start = chunk * run->chunk_points;
+        long long end = start + run->chunk_points < run->points ? start + run->chunk_points : run->points;
+        double sum;
+        if (worker_range_sum(run, worker, start, end, &sum) != 0) {
+            orphan_chunk(run, chunk);
+            break;
+        }
+        neumaier_add(&worker->sum, &worker->comp, sum);
+        worker->chunks_done++;
+    }
+
+    return NULL;
+}
+
+// Calibration, on all workers at once: a short discarded warmup takes the
+// first launch's kernel creation and allocations out of the measurement, then
+// worker i times chunk i. That chunk is real work and stays in the sum.
+static void *multi_calibrate_main(void *arg) {
+    MultiThread *thread = (MultiThread *)arg;
+    MultiRun *run = thread->run;
+    MultiWorker *worker = &run->workers[thread->index];
+    long long chunk = thread->index;
+    int has_chunk = chunk * run->chunk_points < run->points;
+
+    double sum;
+    if (worker_range_sum(run, worker, 0, run->points < WARMUP_POINTS ? run->points : WARMUP_POINTS, &sum) != 0) {
+        if (has_chunk) {
+            orphan_chunk(run, chunk);
+        }
+        return NULL;
+    }
+    if (!has_chunk) {
+        return NULL;
+    }
+
+    long long start = chunk * run->chunk_points;
+    long long end = start + run->chunk_points < run->points ? start + run->chunk_points : run->points;
+    struct timespec cal_start, cal_end;
+    clock_gettime(CLOCK_MONOTONIC, &cal_start);
+    if (worker_range_sum(run, worker, start, end, &sum) != 0) {
+        orphan_chunk(run, chunk);
+        return NULL;
+    }
+    neumaier_add(&worker->sum, &worker->comp, sum);
+    clock_gettime(CLOCK_MONOTONIC, &cal_end);
+
+    double seconds = get_elapsed_time(cal_start, cal_end);
+    worker->throughput = (end - start) / (seconds > 0.0 ? seconds : 1e-9);
+    worker->chunks_done = 1;
+    return NULL;
+}
+
+// Runs thread_main for every worker concurrently. Returns 0, or -1 if a
+// thread cannot be started; the ones already running are joined first.
+static int run_workers(MultiRun *run, void *(*thread_main)(void *)) {
+    pthread_t threads[MAX_DEVICES + 1];
+    MultiThread thread_args[MAX_DEVICES + 1];
+    int started = 0;
+    for (int i = 0; i < run->count; i++) {
+        thread_args[i].run = run;
+        thread_args[i].index = i;
+        if (pthread_create(&threads[i], NULL, thread_main, &thread_args[i]) != 0) {
+            fprintf(stderr, "Failed to start worker %d.\n", i);
+            break;
+        }
+        started++;
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return started == run->count ? 0 : -1;
+}
+
+// Calibrates every worker on its first chunk, hands out the remaining chunks
+// in proportion to the measured throughput and runs all workers concurrently;
+// work stealing evens out the remaining imbalance. Chunks of a failed worker
+// are rerun on the others until none is left or every worker has failed. elapsed_time receives the
+// wall time; returns 0, or -1 on failure.
+int run_multi(MultiWorker *workers, int count, const CompiledExpression *compiled, double a, double b, long long size, int mode, int func, long long chunk_size, double *final_result, double *elapsed_time) {
+    if (mode < 0 || mode > 2) {
+        fprintf(stderr, "Invalid mode selected.\n");
+        return -1;
+    }
+
+    MultiRun run;
+    run.workers = workers;
+    run.count = count;
+    run.compiled = compiled;
+    run.a = a;
+    run.h = (b - a) / size;
+    run.size = size;
+    run.points = size + 1;
+    run.mode = mode;
+    run.func = func;
+
+    run.chunk_points = chunk_size > 0 ? chunk_size : run.points / (CHUNKS_PER_WORKER * count);
+    if (run.chunk_points < MIN_MULTI_CHUNK) {
+        run.chunk_points = MIN_MULTI_CHUNK;
+    }
+    long long chunk_count = (run.points + run.chunk_points - 1) / run.chunk_points;
+
+    struct timespec start_t, end_t;
+    clock_gettime(CLOCK_MONOTONIC, &start_t);
+
+    for (int i = 0; i < count; i++) {
+        workers[i].throughput = 0.0;
+        workers[i].next_chunk = 0;
+        workers[i].end_chunk = 0;
+        workers[i].chunks_done = 0;
+        workers[i].chunks_stolen = 0;
+        workers[i].sum = 0.0;
+        workers[i].comp = 0.0;
+        workers[i].failed = 0;
+    }
+    run.orphan_count = 0;
+    pthread_mutex_init(&run.lock, NULL);
+    int status = run_workers(&run, multi_calibrate_main);
+
+    double total_throughput = 0.0;
+    int healthy = 0;
+    for (int i = 0; i < count; i++) {
+        total_throughput += workers[i].throughput;
+        healthy += !workers[i].failed;
+    }
+
+    // Chunks [count, chunk_count) are left; a worker without a calibration
+    // chunk gets no share but can still steal. If no worker measured a
+    // throughput, the surviving ones share evenly.
+    long long first = chunk_count < count ? chunk_count : count;
+    double share = 0.0;
+    long long boundary = first;
+    for (int i = 0; status == 0 && healthy > 0 && i < count; i++) {
+        share += total_throughput > 0.0 ? workers[i].throughput / total_throughput : (double)!workers[i].failed / healthy;
+        workers[i].next_chunk = boundary;
+        boundary = i == count - 1 ? chunk_count : first + (long long)((chunk_count - first) * share);
+        workers[i].end_chunk = boundary;
+    }
+
+    // A worker can fail after the others have run out of chunks and left;
+    // its orphan then needs another round.
+    while (status == 0 && healthy > 0 && chunks_left(&run) > 0) {
+        status = run_workers(&run, multi_worker_main);
+        healthy = 0;
+        for (int i = 0; i < count; i++) {
+            healthy += !workers[i].failed;
+        }
+    }
+    pthread_mutex_destroy(&run.lock);
+    if (status != 0) {
+        return -1;
+    }
+    if (healthy == 0) {
+        fprintf(stderr, "Every worker failed.\n");
+        return -1;
+    }
+
+    double total = 0.0;
+    double comp = 0.0;
+    for (int i = 0; i < count; i++) {
+        neumaier_add(&total, &comp, workers[i].sum);
+        comp += workers[i].comp;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end_t);
+
+    *final_result = rule_factor(mode, run.h) * (total + comp);
+    *elapsed_time = get_elapsed_time(start_t, end_t);
+    return 0;
+}
@@ -1,353 +1,950 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <time.h>
-#include <CL/cl.h>
-#include <math.h>
-#include "opencl_utils.h"
-#include "time_utils.h"
-#include "input_utils.h"
-
-#define LOCAL_SIZE 128
-
-char* readKernelSource(const char* filename, size_t* length) {
-    FILE* file = fopen(filename, "rb");
-    if (!file) {
-        fprintf(stderr, "Failed to load kernel.\n");
-        exit(1);
-    }
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    if (file_size == -1) {
-        fprintf(stderr, "Failed to determine file size.\n");
-        fclose(file);
-        exit(1);
-    }
-    rewind(file);
-
-    char* source = (char*)malloc(file_size + 1);
-    if (!source) {
-        fprintf(stderr, "Failed to allocate memory for kernel source.\n");
-        fclose(file);
-        exit(1);
-    }
-
-    size_t read_size = fread(source, 1, file_size, file);
-    if (read_size != file_size) {
-        fprintf(stderr, "Error reading kernel file.\n");
-        free(source);
-        fclose(file);
-        exit(1);
-    }
-    source[file_size] = '\0';
-
-    fclose(file);
-
-    *length = file_size;
-    return source;
-}
-
-cl_kernel create_kernel(cl_program program, int mode, cl_int* ret) {
-    cl_kernel kernel;
-    switch (mode) {
-        case 0:
-            kernel = clCreateKernel(program, "simpson_integral", ret);
-            break;
-        case 1:
-            kernel = clCreateKernel(program, "rectangle_integral", ret);
-            break;
-        case 2:
-            kernel = clCreateKernel(program, "trapezoidal_integral", ret);
-            break;
-        default:
-            fprintf(stderr, "Invalid mode selected.\n");
-            exit(1);
-    }
-    return kernel;
-}
-
-cl_kernel select_function_kernel(cl_program program, int func, cl_int* ret) {
-    switch (func) {
-        case 0: return clCreateKernel(program, "sin_kernel", ret);
-        case 1: return clCreateKernel(program, "cos_kernel", ret);
-        case 2: return clCreateKernel(program, "exp_kernel", ret);
-        case 3: return clCreateKernel(program, "sqrt_kernel", ret);
-        default: return clCreateKernel(program, "log_kernel", ret);
-    }
-}
-
-double run_algorithm(double a, double b, int size, int mode, int func, double* final_result, double* exact_value, double* error) {
-    double h = (b - a) / size;
-    double *x = (double *)malloc((size + 1) * sizeof(double));
-    get_points(x, a, b, size, h);
-
-    cl_platform_id platform_id = NULL;
-    cl_device_id device_id = NULL;
-    cl_uint ret_num_devices;
-    cl_uint ret_num_platforms;
-    cl_int ret;
-
-    ret = clGetPlatformIDs(1, &platform_id, &ret_num_platforms);
-    ret = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_DEFAULT, 1, &device_id, &ret_num_devices);
-
-    cl_context context = clCreateContext(NULL, 1, &device_id, NULL, NULL, &ret);
-    cl_command_queue command_queue = clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &ret);
-
-    size_t source_size;
-    char *source_str = readKernelSource("kernels/integral_kernel.cl", &source_size);
-
-    cl_program program = clCreateProgramWithSource(context, 1, (const char **)&source_str, (const size_t *)&source_size, &ret);
-    ret = clBuildProgram(program, 1, &device_id, NULL, NULL, NULL);
-
-    if (ret != CL_SUCCESS) {
-        size_t log_size;
-        clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-        char *log = (char *)malloc(log_size);
-        clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, log_size, log, NULL);
-        fprintf(stderr, "Error in kernel: %s\n", log);
-        free(log);
-        exit(1);
-    }
-
-    cl_kernel func_kernel = select_function_kernel(program, func, &ret);
-    if (ret != CL_SUCCESS) {
-        fprintf(stderr, "Failed to create function kernel. Error: %d\n", ret);
-        exit(1);
-    }
-
-    cl_kernel integral_kernel = create_kernel(program, mode, &ret);
-    if (ret != CL_SUCCESS) {
-        fprintf(stderr, "Failed to create integration kernel. Error: %d\n", ret);
-        exit(1);
-    }
-
-    cl_kernel final_sum_kernel = clCreateKernel(program, "final_sum_kernel", &ret);
-    if (ret != CL_SUCCESS) {
-        fprintf(stderr, "Failed to create final sum kernel. Error: %d\n", ret);
-        exit(1);
-    }
-
-    cl_mem x_mem = clCreateBuffer(context, CL_MEM_READ_ONLY, (size + 1) * sizeof(double), NULL, &ret);
-    cl_mem results_mem = clCreateBuffer(context, CL_MEM_READ_WRITE, (size + 1) * sizeof(double), NULL, &ret);
-    cl_mem integral_results_mem = clCreateBuffer(context, CL_MEM_WRITE_ONLY, (size + 1) * sizeof(double), NULL, &ret);
-
-    ret = clEnqueueWriteBuffer(command_queue, x_mem, CL_TRUE, 0, (size + 1) * sizeof(double), x, 0, NULL, NULL);
-
-    ret = clSetKernelArg(func_kernel, 0, sizeof(cl_mem), (void *)&x_mem);
-    ret = clSetKernelArg(func_kernel, 1, sizeof(cl_mem), (void *)&results_mem);
-
-    size_t global_item_size = size + 1;
-    size_t local_item_size = LOCAL_SIZE;
-
-    if (global_item_size % local_item_size != 0) {
-        global_item_size = (global_item_size / local_item_size + 1) * local_item_size;
-    }
-
-    cl_event func_event, integral_event, final_sum_event;
-
-    // Function and integral kernels
-    ret = clEnqueueNDRangeKernel(command_queue, func_kernel, 1, NULL, &global_item_size, &local_item_size, 0, NULL, &func_event);
-    ret = clWaitForEvents(1, &func_event);
-    ret = clFinish(command_queue);
-
-    ret = clSetKernelArg(integral_kernel, 0, sizeof(cl_mem), (void *)&results_mem);
-    ret = clSetKernelArg(integral_kernel, 1, sizeof(cl_mem), (void *)&integral_results_mem);
-    ret = clSetKernelArg(integral_kernel, 2, sizeof(int), (void *)&size);
-
-    ret = clEnqueueNDRangeKernel(command_queue, integral_kernel, 1, NULL, &global_item_size, &local_item_size, 0, NULL, &integral_event);
-    ret = clWaitForEvents(1, &integral_event);
-    ret = clFinish(command_queue);
-
-    // Final summary kernel
-    size_t num_work_groups = global_item_size / local_item_size;
-    cl_mem final_sum_results_mem = clCreateBuffer(context, CL_MEM_READ_WRITE, num_work_groups * sizeof(double), NULL, &ret);
-    double *final_sum_results = (double *)malloc(num_work_groups * sizeof(double));
-
-    ret = clSetKernelArg(final_sum_kernel, 0, sizeof(cl_mem), (void *)&integral_results_mem);
-    ret = clSetKernelArg(final_sum_kernel, 1, sizeof(cl_mem), (void *)&final_sum_results_mem);
-    ret = clSetKernelArg(final_sum_kernel, 2, local_item_size * sizeof(double), NULL);
-
-    ret = clEnqueueNDRangeKernel(command_queue, final_sum_kernel, 1, NULL, &global_item_size, &local_item_size, 0, NULL, &final_sum_event);
-    ret = clWaitForEvents(1, &final_sum_event);
-    ret = clFinish(command_queue);
-
-    ret = clEnqueueReadBuffer(command_queue, final_sum_results_mem, CL_TRUE, 0, num_work_groups * sizeof(double), final_sum_results, 0, NULL, NULL);
-
-    double sum = 0.0;
-    for (size_t j = 0; j < num_work_groups; j++) {
-        sum += final_sum_results[j];
-    }
-
-    switch (mode) {
-        case 0:
-            *final_result = (h / 3.0) * sum;
-            break;
-        case 1:
-            *final_result = h * sum;
-            break;
-        case 2:
-            *final_result = (h / 2.0) * sum;
-            break;
-        default:
-            *final_result = sum;
-            break;
-    }
-
-    // Get profiling info
-    cl_ulong time_start, time_end;
-    double nanoSeconds;
-
-    clGetEventProfilingInfo(func_event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
-    clGetEventProfilingInfo(func_event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
-    nanoSeconds = time_end - time_start;
-    double func_time = nanoSeconds / 1000000000.0;
-
-    clGetEventProfilingInfo(integral_event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
-    clGetEventProfilingInfo(integral_event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
-    nanoSeconds = time_end - time_start;
-    double integral_time = nanoSeconds / 1000000000.0;
-
-    clGetEventProfilingInfo(final_sum_event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
-    clGetEventProfilingInfo(final_sum_event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
-    nanoSeconds = time_end - time_start;
-    double final_sum_time = nanoSeconds / 1000000000.0;
-
-    /* printf("Function kernel execution time: %0.10f s\n", func_time);
-    printf("Integral kernel execution time: %0.10f s\n", integral_time);
-    printf("Final sum kernel execution time: %0.10f s\n", final_sum_time); */
-
-    double elapsed_time = func_time + integral_time + final_sum_time;
-    *exact_value = exact_integral(a, b, func);
-    *error = fabs(*final_result - *exact_value);
-
-    ret = clReleaseKernel(func_kernel);
-    ret = clReleaseKernel(integral_kernel);
-    ret = clReleaseKernel(final_sum_kernel);
-    ret = clReleaseProgram(program);
-    ret = clReleaseMemObject(x_mem);
-    ret = clReleaseMemObject(results_mem);
-    ret = clReleaseMemObject(integral_results_mem);
-    ret = clReleaseMemObject(final_sum_results_mem);
-    ret = clReleaseCommandQueue(command_queue);
-    ret = clReleaseContext(context);
-    free(x);
-    free(final_sum_results);
-    free(source_str);
-
-    return elapsed_time;
-}
-
-double run_simpson_nd(double *lower, double *upper, int *n, int dim, int func, double *result) {
-    cl_platform_id platform_id = NULL;
-    cl_device_id device_id = NULL;
-    cl_uint ret_num_devices;
-    cl_uint ret_num_platforms;
-    cl_int ret;
-
-    ret = clGetPlatformIDs(1, &platform_id, &ret_num_platforms);
-    ret = clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_DEFAULT, 1, &device_id, &ret_num_devices);
-
-    cl_context context = clCreateContext(NULL, 1, &device_id, NULL, NULL, &ret);
-    cl_command_queue command_queue = clCreateCommandQueue(context, device_id, CL_QUEUE_PROFILING_ENABLE, &ret);
-
-    size_t source_size;
-    char *source_str = readKernelSource("kernels/integral_kernel.cl", &source_size);
-
-    cl_program program = clCreateProgramWithSource(context, 1, (const char **)&source_str, (const size_t *)&source_size, &ret);
-    ret = clBuildProgram(program, 1, &device_id, NULL, NULL, NULL);
-
-    if (ret != CL_SUCCESS) {
-        size_t log_size;
-        clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-        char *log = (char *)malloc(log_size);
-        clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, log_size, log, NULL);
-        fprintf(stderr, "Error in kernel: %s\n", log);
-        free(log);
-        exit(1);
-    }
-
-    cl_kernel simpson_kernel = clCreateKernel(program, "simpson_kernel", &ret);
-    if (ret != CL_SUCCESS) {
-        fprintf(stderr, "Failed to create simspon kernel. Error: %d\n", ret);
-        exit(1);
-    }
-
-    int total_points = 1;
-    for (int i = 0; i < dim; i++) {
-        total_points *= (n[i] + 1);
-    }
-
-    cl_mem lower_mem = clCreateBuffer(context, CL_MEM_READ_ONLY, dim * sizeof(double), NULL, &ret);
-    cl_mem upper_mem = clCreateBuffer(context, CL_MEM_READ_ONLY, dim * sizeof(double), NULL, &ret);
-    cl_mem n_mem = clCreateBuffer(context, CL_MEM_READ_ONLY, dim * sizeof(int), NULL, &ret);
-    cl_mem results_mem = clCreateBuffer(context, CL_MEM_WRITE_ONLY, total_points * sizeof(double), NULL, &ret);
-
-    ret = clEnqueueWriteBuffer(command_queue, lower_mem, CL_TRUE, 0, dim * sizeof(double), lower, 0, NULL, NULL);
-    ret = clEnqueueWriteBuffer(command_queue, upper_mem, CL_TRUE, 0, dim * sizeof(double), upper, 0, NULL, NULL);
-    ret = clEnqueueWriteBuffer(command_queue, n_mem, CL_TRUE, 0, dim * sizeof(int), n, 0, NULL, NULL);
-
-    ret = clSetKernelArg(simpson_kernel, 0, sizeof(cl_mem), (void *)&lower_mem);
-    ret = clSetKernelArg(simpson_kernel, 1, sizeof(cl_mem), (void *)&upper_mem);
-    ret = clSetKernelArg(simpson_kernel, 2, sizeof(cl_mem), (void *)&n_mem);
-    ret = clSetKernelArg(simpson_kernel, 3, sizeof(cl_mem), (void *)&results_mem);
-    ret = clSetKernelArg(simpson_kernel, 4, sizeof(int), (void *)&dim);
-    ret = clSetKernelArg(simpson_kernel, 5, sizeof(int), (void *)&func);
-
-    size_t global_item_size = total_points;
-    size_t local_item_size = LOCAL_SIZE;
-
-    if (global_item_size % local_item_size != 0) {
-        global_item_size = (global_item_size / local_item_size + 1) * local_item_size;
-    }
-
-    cl_event simpson_event;
-
-    struct timespec start_t, end_t;
-    clock_gettime(CLOCK_MONOTONIC, &start_t);
-
-    ret = clEnqueueNDRangeKernel(command_queue, simpson_kernel, 1, NULL, &global_item_size, &local_item_size, 0, NULL, &simpson_event);
-    ret = clWaitForEvents(1, &simpson_event);
-    ret = clFinish(command_queue);
-
-    double *results = (double *)malloc(total_points * sizeof(double));
-    ret = clEnqueueReadBuffer(command_queue, results_mem, CL_TRUE, 0, total_points * sizeof(double), results, 0, NULL, NULL);
-
-    double sum = 0.0;
-    for (int i = 0; i < total_points; i++) {
-        sum += results[i];
-    }
-
-    clock_gettime(CLOCK_MONOTONIC, &end_t);
-
-    double volume = 1.0;
-    for (int i = 0; i < dim; i++) {
-        volume *= (upper[i] - lower[i]) / (3.0 * n[i]);
-    }
-
-    *result = sum * volume;
-
-    // Get profiling info
-    cl_ulong time_start, time_end;
-    double nanoSeconds;
-
-    clGetEventProfilingInfo(simpson_event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
-    clGetEventProfilingInfo(simpson_event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
-    nanoSeconds = time_end - time_start;
-    double simpson_time = nanoSeconds / 1000000000.0;
-
-    //printf("Simpson kernel execution time: %0.10f s\n", simpson_time);
-
-    double elapsed_time = simpson_time;
-
-    ret = clReleaseKernel(simpson_kernel);
-    ret = clReleaseProgram(program);
-    ret = clReleaseMemObject(lower_mem);
-    ret = clReleaseMemObject(upper_mem);
-    ret = clReleaseMemObject(n_mem);
-    ret = clReleaseMemObject(results_mem);
-    ret = clReleaseCommandQueue(command_queue);
-    ret = clReleaseContext(context);
-    free(results);
-    free(source_str);
-
-    return elapsed_time;
-}
\ No newline at end of file
+#include <stdio.h>
+#include <stdlib.h>
+#include <CL/cl.h>
+#include <math.h>
+#include <string.h>
+#include "opencl_utils.h"
+#include "cache_utils.h"
+#include "input_utils.h"
+#include "expr_utils.h"
+#include "tune_utils.h"
+#include "async_utils.h"
+#include "trace_utils.h"
+
+char* readKernelSource(const char* filename, size_t* length) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "Failed to load kernel.\n");
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    if (file_size == -1) {
+        fprintf(stderr, "Failed to determine file size.\n");
+        fclose(file);
+        return NULL;
+    }
+    rewind(file);
+
+    char* source = (char*)malloc(file_size + 1);
+    if (!source) {
+        fprintf(stderr, "Failed to allocate memory for kernel source.\n");
+        fclose(file);
+        return NULL;
+    }
+
+    size_t read_size = fread(source, 1, file_size, file);
+    if (read_size != file_size) {
+        fprintf(stderr, "Error reading kernel file.\n");
+        free(source);
+        fclose(file);
+        return NULL;
+    }
+    source[file_size] = '\0';
+
+    fclose(file);
+
+    *length = file_size;
+    return source;
+}
+
+int check_build(cl_program program, cl_device_id device_id, cl_int ret) {
+    if (ret != CL_SUCCESS) {
+        size_t log_size = 0;
+        clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+        char *log = (char *)malloc(log_size + 1);
+        if (log != NULL) {
+            log[0] = '\0';
+            clGetProgramBuildInfo(program, device_id, CL_PROGRAM_BUILD_LOG, log_size, log, NULL);
+            log[log_size] = '\0';
+        }
+        fprintf(stderr, "Error in kernel: %s\n", log != NULL ? log : "");
+        free(log);
+        return -1;
+    }
+    return 0;
+}
+
+// Device + source + build options: the key of the binary cache, the tuning
+// file and the dispatch model.
+unsigned long long program_cache_key(cl_device_id device_id, const char* source, size_t source_size, const char* options) {
+    unsigned long long key = hash_device(device_id);
+    key = hash_bytes(source, source_size, key);
+    if (options != NULL) {
+        key = hash_bytes(options, strlen(options), key);
+    }
+    return key;
+}
+
+cl_program build_program(OpenCLEngine* engine, const char* source, size_t source_size, const char* options) {
+    unsigned long long key = program_cache_key(engine->device_id, source, source_size, options);
+    engine->program_key = key;
+
+    char path[1024];
+    get_cache_path(path, sizeof(path), "program", key, "bin");
+
+    double trace_start = trace_now();
+    cl_program program = load_program_binary(engine->context, engine->device_id, path, options);
+    if (program != NULL) {
+        trace_host("load program binary", trace_start);
+        return program;
+    }
+
+    cl_int ret;
+    program = clCreateProgramWithSource(engine->context, 1, &source, &source_size, &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create program. Error: %d\n", ret);
+        return NULL;
+    }
+
+    ret = clBuildProgram(program, 1, &engine->device_id, options, NULL, NULL);
+    if (check_build(program, engine->device_id, ret) != 0) {
+        clReleaseProgram(program);
+        return NULL;
+    }
+
+    if (save_program_binary(program, path) != 0) {
+        fprintf(stderr, "Warning: could not write program cache %s\n", path);
+    }
+    trace_host("build program", trace_start);
+
+    return program;
+}
+
+int select_default_device(cl_platform_id* platform_id, cl_device_id* device_id) {
+    cl_uint ret_num_devices;
+    cl_uint ret_num_platforms;
+    cl_int ret;
+    double trace_start = trace_now();
+
+    ret = clGetPlatformIDs(1, platform_id, &ret_num_platforms);
+    if (ret != CL_SUCCESS || ret_num_platforms == 0) {
+        fprintf(stderr, "No OpenCL platform found. Error: %d\n", ret);
+        return -1;
+    }
+
+    ret = clGetDeviceIDs(*platform_id, CL_DEVICE_TYPE_DEFAULT, 1, device_id, &ret_num_devices);
+    if (ret != CL_SUCCESS || ret_num_devices == 0) {
+        fprintf(stderr, "No OpenCL device found. Error: %d\n", ret);
+        return -1;
+    }
+    trace_host("device query", trace_start);
+    return 0;
+}
+
+// The fp64 and mixed variants use double, so a device without cl_khr_fp64
+// can only build the fp32 one.
+int device_supports_fp64(cl_device_id device_id) {
+    cl_device_fp_config config = 0;
+    if (clGetDeviceInfo(device_id, CL_DEVICE_DOUBLE_FP_CONFIG, sizeof(config), &config, NULL) == CL_SUCCESS && config != 0) {
+        return 1;
+    }
+
+    size_t size = 0;
+    if (clGetDeviceInfo(device_id, CL_DEVICE_EXTENSIONS, 0, NULL, &size) != CL_SUCCESS || size == 0) {
+        return 0;
+    }
+    char *extensions = (char *)malloc(size);
+    if (extensions == NULL) {
+        return 0;
+    }
+    int supported = clGetDeviceInfo(device_id, CL_DEVICE_EXTENSIONS, size, extensions, NULL) == CL_SUCCESS && strstr(extensions, "cl_khr_fp64") != NULL;
+    free(extensions);
+    return supported;
+}
+
+// The kernel file with prefix (if not NULL) in front of it.
+static char* read_program_source(const char* kernel_file, const char* prefix, size_t* source_size) {
+    char *source_str = readKernelSource(kernel_file, source_size);
+    if (source_str == NULL || prefix == NULL) {
+        return source_str;
+    }
+
+    size_t prefix_size = strlen(prefix);
+    char *full_source = (char *)malloc(prefix_size + *source_size + 1);
+    if (!full_source) {
+        fprintf(stderr, "Failed to allocate memory for kernel source.\n");
+        free(source_str);
+        return NULL;
+    }
+    memcpy(full_source, prefix, prefix_size);
+    memcpy(full_source + prefix_size, source_str, *source_size + 1);
+    free(source_str);
+    *source_size += prefix_size;
+    return full_source;
+}
+
+// Creates the context, queue and program for one device. A non-NULL prefix
+// (the --expr integrand) is placed in front of the kernel source, and
+// build_options selects the kernel variant. Returns 0, or -1 with nothing
+// left allocated.
+int engine_create(OpenCLEngine* engine, cl_platform_id platform_id, cl_device_id device_id, const char* kernel_file, const char* prefix, const char* build_options) {
+    cl_int ret;
+    double trace_start = trace_now();
+
+    memset(engine, 0, sizeof(*engine));
+    engine->platform_id = platform_id;
+    engine->device_id = device_id;
+    engine->local_size = LOCAL_SIZE;
+    engine->items_per_thread = DEFAULT_ITEMS_PER_THREAD;
+    engine->vector_width = 1;
+
+    // Only the fp32 variant is free of double; see get_build_options.
+    engine->real_size = build_options != NULL && strstr(build_options, "-DPRECISION_FP32") != NULL ? sizeof(float) : sizeof(double);
+    if (engine->real_size == sizeof(double) && !device_supports_fp64(device_id)) {
+        char device_name[128] = "";
+        clGetDeviceInfo(device_id, CL_DEVICE_NAME, sizeof(device_name), device_name, NULL);
+        fprintf(stderr, "OpenCL device %s has no double precision support (cl_khr_fp64); only --precision fp32 runs on it.\n", device_name);
+        return -1;
+    }
+
+    engine->context = clCreateContext(NULL, 1, &engine->device_id, NULL, NULL, &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create context. Error: %d\n", ret);
+        engine->context = NULL;
+        return -1;
+    }
+
+    engine->command_queue = clCreateCommandQueue(engine->context, engine->device_id, CL_QUEUE_PROFILING_ENABLE, &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create command queue. Error: %d\n", ret);
+        engine->command_queue = NULL;
+        engine_destroy(engine);
+        return -1;
+    }
+
+    // Asynchronous chains carry their own event dependencies, so independent
+    // integrations may overlap where out-of-order execution is supported.
+    engine->async_queue = clCreateCommandQueue(engine->context, engine->device_id, CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &ret);
+    if (ret != CL_SUCCESS) {
+        engine->async_queue = clCreateCommandQueue(engine->context, engine->device_id, CL_QUEUE_PROFILING_ENABLE, &ret);
+    }
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create asynchronous command queue. Error: %d\n", ret);
+        engine->async_queue = NULL;
+        engine_destroy(engine);
+        return -1;
+    }
+    trace_host("create context", trace_start);
+
+    trace_start = trace_now();
+    size_t source_size;
+    char *source_str = read_program_source(kernel_file, prefix, &source_size);
+    if (source_str == NULL) {
+        engine_destroy(engine);
+        return -1;
+    }
+    trace_host("read kernel source", trace_start);
+    engine->program = build_program(engine, source_str, source_size, build_options);
+    free(source_str);
+    if (engine->program == NULL) {
+        engine_destroy(engine);
+        return -1;
+    }
+    return 0;
+}
+
+int engine_init_with_prefix(OpenCLEngine* engine, const char* kernel_file, const char* prefix) {
+    cl_platform_id platform_id;
+    cl_device_id device_id;
+    if (select_default_device(&platform_id, &device_id) != 0) {
+        return -1;
+    }
+    return engine_create(engine, platform_id, device_id, kernel_file, prefix, NULL);
+}
+
+int engine_init(OpenCLEngine* engine, const char* kernel_file) {
+    return engine_init_with_prefix(engine, kernel_file, NULL);
+}
+
+// Preprocessor defines for the --precision and --native-math variants. They
+// are part of the program cache key, so every variant is built and tuned once.
+void get_build_options(const Options* options, char* buffer, size_t buffer_size) {
+    buffer[0] = '\0';
+    if (options->precision == PRECISION_FP32) {
+        // Unsuffixed literals (also in --expr code) would otherwise be double.
+        snprintf(buffer, buffer_size, "-DPRECISION_FP32 -cl-single-precision-constant");
+    } else if (options->precision == PRECISION_MIXED) {
+        snprintf(buffer, buffer_size, "-DPRECISION_MIXED");
+    }
+
+    if (options->native_math) {
+        if (buffer[0] == '\0') {
+            fprintf(stderr, "Warning: --native-math only applies to --precision fp32 or mixed\n");
+        } else {
+            size_t length = strlen(buffer);
+            snprintf(buffer + length, buffer_size - length, " -DNATIVE_MATH");
+        }
+    }
+}
+
+// Lanes per work-item for fused_integral: --vector-width if given, else the
+// device's preferred vector width for the type the integrand is evaluated
+// in, rounded down to an OpenCL vector size (at most 16).
+int get_vector_width(cl_device_id device_id, const Options* options) {
+    cl_uint width = (cl_uint)options->vector_width;
+    if (width == 0) {
+        cl_device_info info = options->precision == PRECISION_FP64 ? CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE : CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT;
+        if (clGetDeviceInfo(device_id, info, sizeof(width), &width, NULL) != CL_SUCCESS) {
+            width = 1;
+        }
+    }
+
+    int lanes = 1;
+    while (lanes < 16 && (cl_uint)lanes * 2 <= width) {
+        lanes *= 2;
+    }
+    return lanes;
+}
+
+// The --expr prefix (NULL without --expr), the build options that
+// engine_init_device compiles the program with for this device, and the
+// fused_integral vector width those options select.
+static int program_variant(cl_device_id device_id, const Options* options, char** prefix, char* build_options, size_t build_options_size, int* vector_width) {
+    *prefix = NULL;
+    if (options->expr != NULL) {
+        char code[MAX_EXPR_CODE];
+        char message[256];
+        if (expr_to_code(options->expr, code, sizeof(code), message, sizeof(message)) != 0) {
+            fprintf(stderr, "Invalid expression \"%s\": %s\n", options->expr, message);
+            return -1;
+        }
+        *prefix = expr_opencl_prefix(code);
+        if (*prefix == NULL) {
+            fprintf(stderr, "Failed to allocate memory for kernel source.\n");
+            return -1;
+        }
+    }
+
+    get_build_options(options, build_options, build_options_size);
+
+    *vector_width = get_vector_width(device_id, options);
+    if (*vector_width > 1) {
+        size_t length = strlen(build_options);
+        snprintf(build_options + length, build_options_size - length, "%s-DVECTOR_WIDTH=%d", length > 0 ? " " : "", *vector_width);
+    }
+    return 0;
+}
+
+int engine_init_device(OpenCLEngine* engine, cl_platform_id platform_id, cl_device_id device_id, const char* kernel_file, const Options* options) {
+    char *prefix;
+    char build_options[128];
+    int vector_width;
+    if (program_variant(device_id, options, &prefix, build_options, sizeof(build_options), &vector_width) != 0) {
+        return -1;
+    }
+
+    int status = engine_create(engine, platform_id, device_id, kernel_file, prefix, build_options[0] != '\0' ? build_options : NULL);
+    free(prefix);
+    if (status != 0) {
+        return -1;
+    }
+    engine->compensated = options->compensated;
+    engine->chunk_size = options->chunk_size;
+    engine->vector_width = vector_width;
+
+    double trace_start = trace_now();
+    if (apply_tuning(engine, options->tune) != 0) {
+        engine_destroy(engine);
+        return -1;
+    }
+    trace_host("tuning", trace_start);
+    return 0;
+}
+
+// The program_key engine_init_options would produce, without creating a
+// context or building anything. Returns -1 if there is no OpenCL device.
+int options_program_key(const char* kernel_file, const Options* options, unsigned long long* key) {
+    cl_platform_id platform_id;
+    cl_device_id device_id;
+    if (select_default_device(&platform_id, &device_id) != 0) {
+        return -1;
+    }
+
+    char *prefix;
+    char build_options[128];
+    int vector_width;
+    if (program_variant(device_id, options, &prefix, build_options, sizeof(build_options), &vector_width) != 0) {
+        return -1;
+    }
+    size_t source_size;
+    char *source_str = read_program_source(kernel_file, prefix, &source_size);
+    free(prefix);
+    if (source_str == NULL) {
+        return -1;
+    }
+
+    *key = program_cache_key(device_id, source_str, source_size, build_options[0] != '\0' ? build_options : NULL);
+    free(source_str);
+    return 0;
+}
+
+int engine_init_options(OpenCLEngine* engine, const char* kernel_file, const Options* options) {
+    cl_platform_id platform_id;
+    cl_device_id device_id;
+    if (select_default_device(&platform_id, &device_id) != 0) {
+        return -1;
+    }
+    return engine_init_device(engine, platform_id, device_id, kernel_file, options);
+}
+
+void get_device_description(OpenCLEngine* engine, char* buffer, size_t buffer_size) {
+    char platform_name[128] = "", device_name[128] = "", driver_version[64] = "";
+    cl_uint compute_units = 0;
+    cl_ulong global_mem = 0;
+
+    clGetPlatformInfo(engine->platform_id, CL_PLATFORM_NAME, sizeof(platform_name), platform_name, NULL);
+    clGetDeviceInfo(engine->device_id, CL_DEVICE_NAME, sizeof(device_name), device_name, NULL);
+    clGetDeviceInfo(engine->device_id, CL_DRIVER_VERSION, sizeof(driver_version), driver_version, NULL);
+    clGetDeviceInfo(engine->device_id, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, NULL);
+    clGetDeviceInfo(engine->device_id, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(global_mem), &global_mem, NULL);
+
+    snprintf(buffer, buffer_size, "%s / %s (driver %s, %u compute units, %llu MiB)", platform_name, device_name, driver_version, compute_units, (unsigned long long)(global_mem >> 20));
+}
+
+// Also releases a partly created engine; missing objects are NULL.
+void engine_destroy(OpenCLEngine* engine) {
+    if (engine->program != NULL) {
+        clReleaseProgram(engine->program);
+    }
+    if (engine->async_queue != NULL) {
+        clReleaseCommandQueue(engine->async_queue);
+    }
+    if (engine->command_queue != NULL) {
+        clReleaseCommandQueue(engine->command_queue);
+    }
+    if (engine->context != NULL) {
+        clReleaseContext(engine->context);
+    }
+}
+
+double event_seconds(cl_event event) {
+    cl_ulong time_start, time_end;
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(time_start), &time_start, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(time_end), &time_end, NULL);
+    return (time_end - time_start) / 1000000000.0;
+}
+
+// Kernel scalars and buffers are real_t (see integral_kernel.cl), while the
+// host works in double: these narrow values on the way in and widen them on
+// the way out when the engine runs the fp32 variant.
+cl_int set_real_arg(const OpenCLEngine* engine, cl_kernel kernel, cl_uint index, double value) {
+    if (engine->real_size == sizeof(float)) {
+        float narrow = (float)value;
+        return clSetKernelArg(kernel, index, sizeof(narrow), (void *)&narrow);
+    }
+    return clSetKernelArg(kernel, index, sizeof(value), (void *)&value);
+}
+
+// Read-only device copy of count values.
+cl_mem create_real_buffer(const OpenCLEngine* engine, const double* values, size_t count, cl_int* ret) {
+    cl_mem_flags flags = CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR;
+    if (engine->real_size == sizeof(double)) {
+        return clCreateBuffer(engine->context, flags, count * sizeof(double), (void *)values, ret);
+    }
+
+    float *narrow = (float *)malloc(count * sizeof(float));
+    if (narrow == NULL) {
+        *ret = CL_OUT_OF_HOST_MEMORY;
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        narrow[i] = (float)values[i];
+    }
+    cl_mem mem = clCreateBuffer(engine->context, flags, count * sizeof(float), narrow, ret);
+    free(narrow);
+    return mem;
+}
+
+// Blocking write of count values to the start of mem, narrowed when needed.
+cl_int write_real_buffer(const OpenCLEngine* engine, cl_command_queue queue, cl_mem mem, const double* values, size_t count, cl_event* event) {
+    if (engine->real_size == sizeof(double)) {
+        return clEnqueueWriteBuffer(queue, mem, CL_TRUE, 0, count * sizeof(double), values, 0, NULL, event);
+    }
+
+    float *narrow = (float *)malloc(count * sizeof(float));
+    if (narrow == NULL) {
+        return CL_OUT_OF_HOST_MEMORY;
+    }
+    for (size_t i = 0; i < count; i++) {
+        narrow[i] = (float)values[i];
+    }
+    cl_int ret = clEnqueueWriteBuffer(queue, mem, CL_TRUE, 0, count * sizeof(float), narrow, 0, NULL, event);
+    free(narrow);
+    return ret;
+}
+
+// Releases mem unless it was never created, for cleanup after partial setup.
+void release_mem(cl_mem mem) {
+    if (mem != NULL) {
+        clReleaseMemObject(mem);
+    }
+}
+
+// values holds count real_t just read from the device; widens them in place.
+// Going down from the end, no float is overwritten before it is read.
+void widen_reals(const OpenCLEngine* engine, double* values, size_t count) {
+    if (engine->real_size != sizeof(float)) {
+        return;
+    }
+    for (size_t i = count; i-- > 0;) {
+        float narrow;
+        memcpy(&narrow, (char *)values + i * sizeof(float), sizeof(narrow));
+        values[i] = narrow;
+    }
+}
+
+// Reduces count partial pairs to *sum, adding the device time of every pass
+// to *kernel_time (if not NULL). Returns 0, or -1 if a pass fails.
+int reduce_on_device(OpenCLEngine* engine, cl_mem partial_sums_mem, size_t count, double* sum, double* kernel_time) {
+    cl_int ret;
+    cl_kernel final_sum_kernel = clCreateKernel(engine->program, "final_sum_kernel", &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create final sum kernel. Error: %d\n", ret);
+        return -1;
+    }
+
+    size_t local_item_size = engine->local_size;
+    cl_mem input_mem = partial_sums_mem;
+    int status = 0;
+
+    // Each pass shrinks the pair count by local_size * REDUCE_ITEMS_PER_THREAD.
+    while (count > 1) {
+        size_t num_work_groups = (count + local_item_size * REDUCE_ITEMS_PER_THREAD - 1) / (local_item_size * REDUCE_ITEMS_PER_THREAD);
+        size_t global_item_size = num_work_groups * local_item_size;
+        cl_long input_count = (cl_long)count;
+
+        cl_mem output_mem = clCreateBuffer(engine->context, CL_MEM_READ_WRITE, num_work_groups * 2 * engine->real_size, NULL, &ret);
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to create reduction buffer. Error: %d\n", ret);
+            status = -1;
+            break;
+        }
+
+        ret = clSetKernelArg(final_sum_kernel, 0, sizeof(cl_mem), (void *)&input_mem);
+        ret |= clSetKernelArg(final_sum_kernel, 1, sizeof(cl_long), (void *)&input_count);
+        ret |= clSetKernelArg(final_sum_kernel, 2, sizeof(int), (void *)&engine->compensated);
+        ret |= clSetKernelArg(final_sum_kernel, 3, sizeof(cl_mem), (void *)&output_mem);
+        ret |= clSetKernelArg(final_sum_kernel, 4, local_item_size * engine->real_size, NULL);
+        ret |= clSetKernelArg(final_sum_kernel, 5, local_item_size * engine->real_size, NULL);
+
+        cl_event final_sum_event;
+        if (ret == CL_SUCCESS) {
+            ret = clEnqueueNDRangeKernel(engine->command_queue, final_sum_kernel, 1, NULL, &global_item_size, &local_item_size, 0, NULL, &final_sum_event);
+        }
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to enqueue final sum kernel. Error: %d\n", ret);
+            clReleaseMemObject(output_mem);
+            status = -1;
+            break;
+        }
+        clWaitForEvents(1, &final_sum_event);
+        trace_command("final_sum_kernel", final_sum_event);
+        if (kernel_time != NULL) {
+            *kernel_time += event_seconds(final_sum_event);
+        }
+        clReleaseEvent(final_sum_event);
+
+        if (input_mem != partial_sums_mem) {
+            clReleaseMemObject(input_mem);
+        }
+        input_mem = output_mem;
+        count = num_work_groups;
+    }
+
+    if (status == 0) {
+        double result[2];
+        cl_event read_event;
+        ret = clEnqueueReadBuffer(engine->command_queue, input_mem, CL_TRUE, 0, 2 * engine->real_size, result, 0, NULL, trace_slot(&read_event));
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to read reduction result. Error: %d\n", ret);
+            status = -1;
+        } else {
+            trace_collect("read result", &read_event);
+            widen_reals(engine, result, 2);
+            *sum = result[0] + result[1];
+        }
+    }
+
+    if (input_mem != partial_sums_mem) {
+        clReleaseMemObject(input_mem);
+    }
+    clReleaseKernel(final_sum_kernel);
+
+    return status;
+}
+
+// One work-item per points_per_item points, rounded up to whole work-groups
+// and capped at MAX_WORK_GROUPS groups; the kernels stride over the rest.
+static size_t capped_global_size(const OpenCLEngine* engine, cl_long points, cl_ulong points_per_item) {
+    size_t local_item_size = engine->local_size;
+    size_t max_items = MAX_WORK_GROUPS * local_item_size;
+    cl_ulong items = ((cl_ulong)points + points_per_item - 1) / points_per_item;
+    if (items >= max_items) {
+        return max_items;
+    }
+
+    size_t global_item_size = (size_t)items;
+    if (global_item_size % local_item_size != 0) {
+        global_item_size = (global_item_size / local_item_size + 1) * local_item_size;
+    }
+    return global_item_size;
+}
+
+// Grid for the scalar kernels: items_per_thread points per work-item.
+size_t kernel_global_size(const OpenCLEngine* engine, cl_long points) {
+    return capped_global_size(engine, points, (cl_ulong)engine->items_per_thread);
+}
+
+// Grid for fused_integral: a work-item of the vector build covers
+// vector_width points per step, so it gets items_per_thread vectors.
+size_t fused_global_size(const OpenCLEngine* engine, cl_long points) {
+    return capped_global_size(engine, points, (cl_ulong)engine->items_per_thread * engine->vector_width);
+}
+
+int set_fused_args(const OpenCLEngine* engine, cl_kernel kernel, double a, double h, cl_long start, cl_long end, cl_long n, int mode, int func, int compensated, cl_mem output_mem, size_t local_size) {
+    cl_int ret;
+    ret = set_real_arg(engine, kernel, 0, a);
+    ret |= set_real_arg(engine, kernel, 1, h);
+    ret |= clSetKernelArg(kernel, 2, sizeof(cl_long), (void *)&start);
+    ret |= clSetKernelArg(kernel, 3, sizeof(cl_long), (void *)&end);
+    ret |= clSetKernelArg(kernel, 4, sizeof(cl_long), (void *)&n);
+    ret |= clSetKernelArg(kernel, 5, sizeof(int), (void *)&mode);
+    ret |= clSetKernelArg(kernel, 6, sizeof(int), (void *)&func);
+    ret |= clSetKernelArg(kernel, 7, sizeof(int), (void *)&compensated);
+    ret |= clSetKernelArg(kernel, 8, sizeof(cl_mem), (void *)&output_mem);
+    ret |= clSetKernelArg(kernel, 9, local_size * engine->real_size, NULL);
+    ret |= clSetKernelArg(kernel, 10, local_size * engine->real_size, NULL);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to set fused kernel arguments. Error: %d\n", ret);
+        return -1;
+    }
+    return 0;
+}
+
+// Weighted sum over the point indices [start, end) of a rule with size
+// intervals: one fused launch plus the on-device reduction, chained by
+// events and waited for once. elapsed_time receives the kernel time.
+int fused_range_sum(OpenCLEngine* engine, double a, double h, long long start, long long end, long long size, int mode, int func, double* sum, double* elapsed_time) {
+    IntegralFuture* future = range_sum_async(engine, a, h, start, end, size, mode, func, NULL, NULL);
+    if (future == NULL) {
+        return -1;
+    }
+    return future_get(future, sum, elapsed_time);
+}
+
+int fused_sum(OpenCLEngine* engine, double a, double h, long long size, int mode, int func, double* sum, double* elapsed_time) {
+    return fused_range_sum(engine, a, h, 0, size + 1, size, mode, func, sum, elapsed_time);
+}
+
+// Waits for one chunk's read, adds the device time of its two kernels to
+// kernel_time and releases the events. Returns -1 if the chunk failed.
+static int collect_chunk(cl_event fused_event, cl_event reduce_event, cl_event read_event, double* kernel_time) {
+    int status = 0;
+    if (clWaitForEvents(1, &read_event) != CL_SUCCESS) {
+        fprintf(stderr, "Chunk failed on the device.\n");
+        status = -1;
+    } else {
+        trace_command("fused_integral", fused_event);
+        trace_command("final_sum_kernel", reduce_event);
+        trace_command("read chunk sum", read_event);
+        *kernel_time += event_seconds(fused_event) + event_seconds(reduce_event);
+    }
+    clReleaseEvent(fused_event);
+    clReleaseEvent(reduce_event);
+    clReleaseEvent(read_event);
+    return status;
+}
+
+// Streams [0, n] through the device in slices of engine->chunk_size points.
+// Every stream owns a queue, a kernel object and a two-stage buffer set, so
+// while one stream's chunk runs, the previous chunk's single reduced pair is
+// already being read back on another queue. Memory use does not depend on n.
+// Like fused_sum, elapsed_time receives the summed kernel time of every chunk.
+int chunked_sum(OpenCLEngine* engine, double a, double h, long long size, int mode, int func, double* sum, double* elapsed_time) {
+    cl_command_queue queues[NUM_STREAMS] = { NULL };
+    cl_kernel fused_kernels[NUM_STREAMS] = { NULL };
+    cl_kernel final_sum_kernels[NUM_STREAMS] = { NULL };
+    cl_mem partial_sums_mem[NUM_STREAMS] = { NULL };
+    cl_mem chunk_sum_mem[NUM_STREAMS] = { NULL };
+    cl_event read_events[NUM_STREAMS] = { NULL };
+    cl_event fused_events[NUM_STREAMS] = { NULL };
+    cl_event reduce_events[NUM_STREAMS] = { NULL };
+    double chunk_sums[NUM_STREAMS][2];
+    int in_flight[NUM_STREAMS] = { 0 };
+    int status = 0;
+    cl_int ret;
+
+    size_t local_item_size = engine->local_size;
+    size_t max_groups = fused_global_size(engine, engine->chunk_size) / local_item_size;
+
+    for (int s = 0; s < NUM_STREAMS && status == 0; s++) {
+        queues[s] = clCreateCommandQueue(engine->context, engine->device_id, CL_QUEUE_PROFILING_ENABLE, &ret);
+        if (ret == CL_SUCCESS) {
+            fused_kernels[s] = clCreateKernel(engine->program, "fused_integral", &ret);
+        }
+        if (ret == CL_SUCCESS) {
+            final_sum_kernels[s] = clCreateKernel(engine->program, "final_sum_kernel", &ret);
+        }
+        if (ret == CL_SUCCESS) {
+            partial_sums_mem[s] = clCreateBuffer(engine->context, CL_MEM_READ_WRITE, max_groups * 2 * engine->real_size, NULL, &ret);
+        }
+        if (ret == CL_SUCCESS) {
+            chunk_sum_mem[s] = clCreateBuffer(engine->context, CL_MEM_READ_WRITE, 2 * engine->real_size, NULL, &ret);
+        }
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to set up stream %d. Error: %d\n", s, ret);
+            status = -1;
+        }
+    }
+
+    double total = 0.0;
+    double comp = 0.0;
+    *elapsed_time = 0.0;
+
+    long long points = size + 1;
+    long long chunk = 0;
+    for (cl_long start = 0; start < points && status == 0; start += engine->chunk_size, chunk++) {
+        int s = (int)(chunk % NUM_STREAMS);
+        cl_long end = start + engine->chunk_size < points ? start + engine->chunk_size : points;
+
+        // The stream is reused: collect its previous chunk first.
+        if (in_flight[s]) {
+            in_flight[s] = 0;
+            if (collect_chunk(fused_events[s], reduce_events[s], read_events[s], elapsed_time) != 0) {
+                status = -1;
+                break;
+            }
+            widen_reals(engine, chunk_sums[s], 2);
+            neumaier_add(&total, &comp, chunk_sums[s][0]);
+            comp += chunk_sums[s][1];
+        }
+
+        size_t global_item_size = fused_global_size(engine, end - start);
+        size_t num_work_groups = global_item_size / local_item_size;
+        cl_long group_count = (cl_long)num_work_groups;
+        size_t reduce_item_size = local_item_size;
+
+        if (set_fused_args(engine, fused_kernels[s], a, h, start, end, size, mode, func, engine->compensated, partial_sums_mem[s], local_item_size) != 0) {
+            status = -1;
+            break;
+        }
+        ret = clSetKernelArg(final_sum_kernels[s], 0, sizeof(cl_mem), (void *)&partial_sums_mem[s]);
+        ret |= clSetKernelArg(final_sum_kernels[s], 1, sizeof(cl_long), (void *)&group_count);
+        ret |= clSetKernelArg(final_sum_kernels[s], 2, sizeof(int), (void *)&engine->compensated);
+        ret |= clSetKernelArg(final_sum_kernels[s], 3, sizeof(cl_mem), (void *)&chunk_sum_mem[s]);
+        ret |= clSetKernelArg(final_sum_kernels[s], 4, local_item_size * engine->real_size, NULL);
+        ret |= clSetKernelArg(final_sum_kernels[s], 5, local_item_size * engine->real_size, NULL);
+
+        // One work-group strides over the chunk's partial pairs. The events
+        // are enqueued together, so on failure the stream is drained first.
+        fused_events[s] = reduce_events[s] = read_events[s] = NULL;
+        if (ret == CL_SUCCESS) {
+            ret = clEnqueueNDRangeKernel(queues[s], fused_kernels[s], 1, NULL, &global_item_size, &local_item_size, 0, NULL, &fused_events[s]);
+        }
+        if (ret == CL_SUCCESS) {
+            ret = clEnqueueNDRangeKernel(queues[s], final_sum_kernels[s], 1, NULL, &reduce_item_size, &local_item_size, 0, NULL, &reduce_events[s]);
+        }
+        if (ret == CL_SUCCESS) {
+            ret = clEnqueueReadBuffer(queues[s], chunk_sum_mem[s], CL_FALSE, 0, 2 * engine->real_size, chunk_sums[s], 0, NULL, &read_events[s]);
+        }
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to enqueue chunk %lld. Error: %d\n", chunk, ret);
+            clFinish(queues[s]);
+            if (fused_events[s] != NULL) {
+                clReleaseEvent(fused_events[s]);
+            }
+            if (reduce_events[s] != NULL) {
+                clReleaseEvent(reduce_events[s]);
+            }
+            status = -1;
+            break;
+        }
+        clFlush(queues[s]);
+        in_flight[s] = 1;
+    }
+
+    // Chunks still in flight are collected even after a failure: their reads
+    // target chunk_sums on this stack frame.
+    for (int s = 0; s < NUM_STREAMS; s++) {
+        if (in_flight[s]) {
+            if (collect_chunk(fused_events[s], reduce_events[s], read_events[s], elapsed_time) != 0) {
+                status = -1;
+            }
+            widen_reals(engine, chunk_sums[s], 2);
+            neumaier_add(&total, &comp, chunk_sums[s][0]);
+            comp += chunk_sums[s][1];
+        }
+    }
+
+    for (int s = 0; s < NUM_STREAMS; s++) {
+        if (fused_kernels[s] != NULL) {
+            clReleaseKernel(fused_kernels[s]);
+        }
+        if (final_sum_kernels[s] != NULL) {
+            clReleaseKernel(final_sum_kernels[s]);
+        }
+        if (partial_sums_mem[s] != NULL) {
+            clReleaseMemObject(partial_sums_mem[s]);
+        }
+        if (chunk_sum_mem[s] != NULL) {
+            clReleaseMemObject(chunk_sum_mem[s]);
+        }
+        if (queues[s] != NULL) {
+            clReleaseCommandQueue(queues[s]);
+        }
+    }
+
+    *sum = total + comp;
+    return status;
+}
+
+// Returns 0, or -1 on an invalid mode or a device failure (reported on
+// stderr). elapsed_time receives the kernel time.
+int run_algorithm(OpenCLEngine* engine, double a, double b, long long size, int mode, int func, double* final_result, double* exact_value, double* error, double* elapsed_time) {
+    if (mode < 0 || mode > 2) {
+        fprintf(stderr, "Invalid mode selected.\n");
+        return -1;
+    }
+
+    double h = (b - a) / size;
+    double sum;
+    int status;
+
+    if (engine->chunk_size > 0 && size + 1 > engine->chunk_size) {
+        status = chunked_sum(engine, a, h, size, mode, func, &sum, elapsed_time);
+    } else {
+        status = fused_sum(engine, a, h, size, mode, func, &sum, elapsed_time);
+    }
+    if (status != 0) {
+        return -1;
+    }
+
+    *final_result = rule_factor(mode, h) * sum;
+
+    *exact_value = exact_integral(a, b, func);
+    *error = fabs(*final_result - *exact_value);
+
+    return 0;
+}
+
+int run_simpson_nd(OpenCLEngine* engine, double *lower, double *upper, long long *n, int dim, int func, double *result, double *elapsed_time) {
+    if (dim < 1 || dim > MAX_DIM) {
+        fprintf(stderr, "Dimension must be between 1 and %d.\n", MAX_DIM);
+        return -1;
+    }
+
+    // Separable Simpson weights (1, 4, 2, ..., 4, 1) * h/3 for every
+    // dimension, stored back to back.
+    double h[MAX_DIM];
+    cl_long n_dim[MAX_DIM];
+    cl_long weight_offsets[MAX_DIM];
+    cl_long weight_count = 0;
+    cl_ulong total_points = 1;
+
+    for (int i = 0; i < dim; i++) {
+        if (n[i] <= 0) {
+            fprintf(stderr, "Number of intervals must be positive in dimension %d.\n", i);
+            return -1;
+        }
+        if (total_points > (cl_ulong)CL_LONG_MAX / (cl_ulong)(n[i] + 1)) {
+            fprintf(stderr, "Grid has more than 2^63 points.\n");
+            return -1;
+        }
+        h[i] = (upper[i] - lower[i]) / n[i];
+        n_dim[i] = n[i];
+        weight_offsets[i] = weight_count;
+        weight_count += n[i] + 1;
+        total_points *= (cl_ulong)(n[i] + 1);
+    }
+
+    double *weights = (double *)malloc(weight_count * sizeof(double));
+    if (!weights) {
+        fprintf(stderr, "Failed to allocate Simpson weights.\n");
+        return -1;
+    }
+    for (int i = 0; i < dim; i++) {
+        double *w = weights + weight_offsets[i];
+        for (long long j = 0; j <= n[i]; j++) {
+            double coeff = (j == 0 || j == n[i]) ? 1.0 : ((j & 1) ? 4.0 : 2.0);
+            w[j] = coeff * h[i] / 3.0;
+        }
+    }
+
+    cl_int ret;
+    cl_kernel simpson_kernel = clCreateKernel(engine->program, "simpson_kernel", &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create simspon kernel. Error: %d\n", ret);
+        free(weights);
+        return -1;
+    }
+
+    size_t local_item_size = engine->local_size;
+    size_t global_item_size = kernel_global_size(engine, (cl_long)total_points);
+    size_t num_work_groups = global_item_size / local_item_size;
+    cl_long points = (cl_long)total_points;
+
+    cl_mem_flags flags = CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR;
+    cl_mem lower_mem = NULL, h_mem = NULL, n_mem = NULL, weights_mem = NULL, offsets_mem = NULL, partial_sums_mem = NULL;
+    cl_event simpson_event = NULL;
+    int status = -1;
+
+    lower_mem = create_real_buffer(engine, lower, dim, &ret);
+    if (ret == CL_SUCCESS) {
+        h_mem = create_real_buffer(engine, h, dim, &ret);
+    }
+    if (ret == CL_SUCCESS) {
+        n_mem = clCreateBuffer(engine->context, flags, dim * sizeof(cl_long), n_dim, &ret);
+    }
+    if (ret == CL_SUCCESS) {
+        weights_mem = create_real_buffer(engine, weights, weight_count, &ret);
+    }
+    if (ret == CL_SUCCESS) {
+        offsets_mem = clCreateBuffer(engine->context, flags, dim * sizeof(cl_long), weight_offsets, &ret);
+    }
+    if (ret == CL_SUCCESS) {
+        partial_sums_mem = clCreateBuffer(engine->context, CL_MEM_READ_WRITE, num_work_groups * 2 * engine->real_size, NULL, &ret);
+    }
+
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create Simpson buffers. Error: %d\n", ret);
+    } else {
+        ret = clSetKernelArg(simpson_kernel, 0, sizeof(cl_mem), (void *)&lower_mem);
+        ret |= clSetKernelArg(simpson_kernel, 1, sizeof(cl_mem), (void *)&h_mem);
+        ret |= clSetKernelArg(simpson_kernel, 2, sizeof(cl_mem), (void *)&n_mem);
+        ret |= clSetKernelArg(simpson_kernel, 3, sizeof(cl_mem), (void *)&weights_mem);
+        ret |= clSetKernelArg(simpson_kernel, 4, sizeof(cl_mem), (void *)&offsets_mem);
+        ret |= clSetKernelArg(simpson_kernel, 5, sizeof(cl_long), (void *)&points);
+        ret |= clSetKernelArg(simpson_kernel, 6, sizeof(int), (void *)&dim);
+        ret |= clSetKernelArg(simpson_kernel, 7, sizeof(int), (void *)&func);
+        ret |= clSetKernelArg(simpson_kernel, 8, sizeof(int), (void *)&engine->compensated);
+        ret |= clSetKernelArg(simpson_kernel, 9, sizeof(cl_mem), (void *)&partial_sums_mem);
+        ret |= clSetKernelArg(simpson_kernel, 10, local_item_size * engine->real_size, NULL);
+        ret |= clSetKernelArg(simpson_kernel, 11, local_item_size * engine->real_size, NULL);
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to set Simpson kernel arguments. Error: %d\n", ret);
+        } else if ((ret = clEnqueueNDRangeKernel(engine->command_queue, simpson_kernel, 1, NULL, &global_item_size, &local_item_size, 0, NULL, &simpson_event)) != CL_SUCCESS) {
+            fprintf(stderr, "Failed to enqueue Simpson kernel. Error: %d\n", ret);
+            simpson_event = NULL;
+        } else {
+            clWaitForEvents(1, &simpson_event);
+            trace_command("simpson_kernel", simpson_event);
+            *elapsed_time = event_seconds(simpson_event);
+            status = reduce_on_device(engine, partial_sums_mem, num_work_groups, result, elapsed_time);
+        }
+    }
+
+    if (simpson_event != NULL) {
+        clReleaseEvent(simpson_event);
+    }
+    clReleaseKernel(simpson_kernel);
+    release_mem(lower_mem);
+    release_mem(h_mem);
+    release_mem(n_mem);
+    release_mem(weights_mem);
+    release_mem(offsets_mem);
+    release_mem(partial_sums_mem);
+    free(weights);
+
+    return status;
+}
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <CL/cl.h>
+#include "qmc_utils.h"
+#include "opencl_utils.h"
+#include "trace_utils.h"
+
+// The sample budget is split evenly over the replicates. Each replicate is an
+// independent estimate of the integral; their mean is the result and their
+// spread gives the standard error. elapsed_time receives the kernel time;
+// returns 0, or -1 on invalid arguments or an OpenCL failure.
+int run_qmc(OpenCLEngine* engine, double *lower, double *upper, int dim, long long samples, int func, int sequence, int replicates, unsigned long long seed, double *result, double *std_error, double *elapsed_time) {
+    if (dim < 1 || dim > MAX_DIM) {
+        fprintf(stderr, "Dimension must be between 1 and %d.\n", MAX_DIM);
+        return -1;
+    }
+    if (replicates < 2 || samples < replicates) {
+        fprintf(stderr, "Need at least 2 replicates and one sample per replicate.\n");
+        return -1;
+    }
+
+    cl_long per_replicate = samples / replicates;
+    double volume = 1.0;
+    for (int d = 0; d < dim; d++) {
+        volume *= upper[d] - lower[d];
+    }
+
+    size_t local_item_size[2] = { engine->local_size, 1 };
+    size_t global_item_size[2] = { kernel_global_size(engine, per_replicate), (size_t)replicates };
+    size_t groups_per_replicate = global_item_size[0] / local_item_size[0];
+
+    int *group_offsets = (int *)malloc((replicates + 1) * sizeof(int));
+    double *pairs = (double *)malloc(replicates * 2 * sizeof(double));
+    if (!group_offsets || !pairs) {
+        fprintf(stderr, "Failed to allocate QMC replicate arrays.\n");
+        free(group_offsets);
+        free(pairs);
+        return -1;
+    }
+    for (int r = 0; r <= replicates; r++) {
+        group_offsets[r] = (int)(r * groups_per_replicate);
+    }
+
+    cl_int ret;
+    cl_kernel qmc_kernel = NULL, segmented_kernel = NULL;
+    cl_mem lower_mem = NULL, upper_mem = NULL, offsets_mem = NULL, partial_sums_mem = NULL, replicate_sums_mem = NULL;
+    cl_event qmc_event = NULL, segmented_event = NULL, read_event = NULL;
+    int status = -1;
+
+    qmc_kernel = clCreateKernel(engine->program, "qmc_kernel", &ret);
+    if (ret == CL_SUCCESS) {
+        segmented_kernel = clCreateKernel(engine->program, "segmented_sum_kernel", &ret);
+    }
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create QMC kernels. Error: %d\n", ret);
+    } else {
+        lower_mem = create_real_buffer(engine, lower, dim, &ret);
+        if (ret == CL_SUCCESS) {
+            upper_mem = create_real_buffer(engine, upper, dim, &ret);
+        }
+        if (ret == CL_SUCCESS) {
+            offsets_mem = clCreateBuffer(engine->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, (replicates + 1) * sizeof(int), group_offsets, &ret);
+        }
+        if (ret == CL_SUCCESS) {
+            partial_sums_mem = clCreateBuffer(engine->context, CL_MEM_READ_WRITE, replicates * groups_per_replicate * 2 * engine->real_size, NULL, &ret);
+        }
+        if (ret == CL_SUCCESS) {
+            replicate_sums_mem = clCreateBuffer(engine->context, CL_MEM_WRITE_ONLY, replicates * 2 * engine->real_size, NULL, &ret);
+        }
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to create QMC buffers. Error: %d\n", ret);
+        }
+    }
+
+    if (ret == CL_SUCCESS) {
+        cl_ulong seed_arg = seed;
+        ret = clSetKernelArg(qmc_kernel, 0, sizeof(cl_mem), (void *)&lower_mem);
+        ret |= clSetKernelArg(qmc_kernel, 1, sizeof(cl_mem), (void *)&upper_mem);
+        ret |= clSetKernelArg(qmc_kernel, 2, sizeof(cl_long), (void *)&per_replicate);
+        ret |= clSetKernelArg(qmc_kernel, 3, sizeof(int), (void *)&dim);
+        ret |= clSetKernelArg(qmc_kernel, 4, sizeof(int), (void *)&func);
+        ret |= clSetKernelArg(qmc_kernel, 5, sizeof(int), (void *)&sequence);
+        ret |= clSetKernelArg(qmc_kernel, 6, sizeof(cl_ulong), (void *)&seed_arg);
+        ret |= clSetKernelArg(qmc_kernel, 7, sizeof(int), (void *)&engine->compensated);
+        ret |= clSetKernelArg(qmc_kernel, 8, sizeof(cl_mem), (void *)&partial_sums_mem);
+        ret |= clSetKernelArg(qmc_kernel, 9, local_item_size[0] * engine->real_size, NULL);
+        ret |= clSetKernelArg(qmc_kernel, 10, local_item_size[0] * engine->real_size, NULL);
+
+        ret |= clSetKernelArg(segmented_kernel, 0, sizeof(cl_mem), (void *)&partial_sums_mem);
+        ret |= clSetKernelArg(segmented_kernel, 1, sizeof(cl_mem), (void *)&offsets_mem);
+        ret |= clSetKernelArg(segmented_kernel, 2, sizeof(int), (void *)&engine->compensated);
+        ret |= clSetKernelArg(segmented_kernel, 3, sizeof(cl_mem), (void *)&replicate_sums_mem);
+        ret |= clSetKernelArg(segmented_kernel, 4, local_item_size[0] * engine->real_size, NULL);
+        ret |= clSetKernelArg(segmented_kernel, 5, local_item_size[0] * engine->real_size, NULL);
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to set QMC kernel arguments. Error: %d\n", ret);
+        }
+    }
+
+    if (ret == CL_SUCCESS) {
+        size_t segmented_item_size = (size_t)replicates * local_item_size[0];
+        ret = clEnqueueNDRangeKernel(engine->command_queue, qmc_kernel, 2, NULL, global_item_size, local_item_size, 0, NULL, &qmc_event);
+        if (ret == CL_SUCCESS) {
+            ret = clEnqueueNDRangeKernel(engine->command_queue, segmented_kernel, 1, NULL, &segmented_item_size, &local_item_size[0], 0, NULL, &segmented_event);
+        }
+        if (ret == CL_SUCCESS) {
+            ret = clEnqueueReadBuffer(engine->command_queue, replicate_sums_mem, CL_TRUE, 0, replicates * 2 * engine->real_size, pairs, 0, NULL, trace_slot(&read_event));
+        }
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to run QMC kernels. Error: %d\n", ret);
+            clFinish(engine->command_queue);
+        }
+    }
+
+    if (ret == CL_SUCCESS) {
+        trace_command("qmc_kernel", qmc_event);
+        trace_command("segmented_sum_kernel", segmented_event);
+        trace_collect("read results", &read_event);
+        widen_reals(engine, pairs, 2 * (size_t)replicates);
+
+        double mean = 0.0;
+        for (int r = 0; r < replicates; r++) {
+            mean += volume * (pairs[2 * r] + pairs[2 * r + 1]) / per_replicate;
+        }
+        mean /= replicates;
+
+        double variance = 0.0;
+        for (int r = 0; r < replicates; r++) {
+            double estimate = volume * (pairs[2 * r] + pairs[2 * r + 1]) / per_replicate;
+            variance += (estimate - mean) * (estimate - mean);
+        }
+        variance /= replicates - 1;
+
+        *result = mean;
+        *std_error = sqrt(variance / replicates);
+        *elapsed_time = event_seconds(qmc_event) + event_seconds(segmented_event);
+        status = 0;
+    }
+
+    if (qmc_event != NULL) {
+        clReleaseEvent(qmc_event);
+    }
+    if (segmented_event != NULL) {
+        clReleaseEvent(segmented_event);
+    }
+    if (read_event != NULL) {
+        clReleaseEvent(read_event);
+    }
+    if (qmc_kernel != NULL) {
+        clReleaseKernel(qmc_kernel);
+    }
+    if (segmented_kernel != NULL) {
+        clReleaseKernel(segmented_kernel);
+    }
+    release_mem(lower_mem);
+    release_mem(upper_mem);
+    release_mem(offsets_mem);
+    release_mem(partial_sums_mem);
+    release_mem(replicate_sums_mem);
+    free(group_offsets);
+    free(pairs);
+
+    return status;
+}
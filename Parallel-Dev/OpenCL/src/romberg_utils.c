@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "romberg_utils.h"
+#include "opencl_utils.h"
+#include "input_utils.h"
+
+// Romberg integration. Level k is the trapezoidal rule with 2^k intervals:
+// T_k = T_{k-1} / 2 + h_k * (sum of f at the 2^(k-1) new midpoints), so every
+// level launches fused_integral over the new points only and nothing is
+// evaluated twice. Row k of the Richardson table is extrapolated from T_k
+// and row k-1; the run stops when two diagonal entries agree to within the
+// tolerance, after at least ROMBERG_MIN_LEVELS levels. elapsed_time receives
+// the kernel time of all levels; returns 0, or -1 if a level fails.
+int run_romberg(OpenCLEngine* engine, double a, double b, double tolerance, int func, double* final_result, double* exact_value, double* error, long long* evaluations, int* levels, double* elapsed_time) {
+    double previous[ROMBERG_MAX_LEVELS + 1];
+    double current[ROMBERG_MAX_LEVELS + 1];
+    double sum, level_time;
+    *elapsed_time = 0.0;
+
+    // Level 0: the two end points, weight 1 each (rectangle weights).
+    if (fused_range_sum(engine, a, b - a, 0, 2, 1, 1, func, &sum, &level_time) != 0) {
+        return -1;
+    }
+    *elapsed_time += level_time;
+    previous[0] = 0.5 * (b - a) * sum;
+    *evaluations = 2;
+    *final_result = previous[0];
+    *levels = 1;
+
+    for (int k = 1; k <= ROMBERG_MAX_LEVELS; k++) {
+        long long new_points = 1LL << (k - 1);
+        double h = (b - a) / (double)(2 * new_points);
+
+        // Midpoints a + (2j + 1) h, j = 0 .. new_points - 1.
+        if (fused_range_sum(engine, a + h, 2.0 * h, 0, new_points, new_points, 1, func, &sum, &level_time) != 0) {
+            return -1;
+        }
+        *elapsed_time += level_time;
+        *evaluations += new_points;
+
+        current[0] = 0.5 * previous[0] + h * sum;
+        double factor = 1.0;
+        for (int j = 1; j <= k; j++) {
+            factor *= 4.0;
+            current[j] = current[j - 1] + (current[j - 1] - previous[j - 1]) / (factor - 1.0);
+        }
+
+        double change = fabs(current[k] - previous[k - 1]);
+        *final_result = current[k];
+        *levels = k + 1;
+
+        for (int j = 0; j <= k; j++) {
+            previous[j] = current[j];
+        }
+
+        if (k + 1 >= ROMBERG_MIN_LEVELS && change <= tolerance) {
+            break;
+        }
+    }
+
+    *exact_value = exact_integral(a, b, func);
+    *error = fabs(*final_result - *exact_value);
+
+    return 0;
+}
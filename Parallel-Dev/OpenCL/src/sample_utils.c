@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <CL/cl.h>
+#include "sample_utils.h"
+#include "opencl_utils.h"
+#include "input_utils.h"
+#include "time_utils.h"
+#include "trace_utils.h"
+
+int open_samples(const char* path, SampleFile* file) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        fprintf(stderr, "Empty or unreadable sample file: %s\n", path);
+        close(fd);
+        return -1;
+    }
+
+    file->map_size = (size_t)info.st_size;
+    file->map = mmap(NULL, file->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file->map == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    madvise(file->map, file->map_size, MADV_SEQUENTIAL);
+
+    size_t offset = 0;
+    file->has_range = 0;
+    if (file->map_size >= SAMPLE_HEADER_SIZE && memcmp(file->map, SAMPLE_MAGIC, strlen(SAMPLE_MAGIC)) == 0) {
+        const double *range = (const double *)((const char *)file->map + strlen(SAMPLE_MAGIC));
+        file->a = range[0];
+        file->b = range[1];
+        file->has_range = 1;
+        offset = SAMPLE_HEADER_SIZE;
+    }
+
+    if ((file->map_size - offset) % sizeof(double) != 0 || (file->map_size - offset) / sizeof(double) < 2) {
+        fprintf(stderr, "Sample file %s must hold at least two doubles after the header.\n", path);
+        munmap(file->map, file->map_size);
+        return -1;
+    }
+
+    file->samples = (const double *)((const char *)file->map + offset);
+    file->count = (long long)((file->map_size - offset) / sizeof(double));
+    return 0;
+}
+
+void close_samples(SampleFile* file) {
+    munmap(file->map, file->map_size);
+}
+
+// Gives the pages of samples [start, end) back to the page cache once the
+// device no longer needs them, so resident memory stays at a few chunks.
+static void drop_samples(const SampleFile* file, long long start, long long end) {
+    long page = sysconf(_SC_PAGESIZE);
+    size_t first = (size_t)((const char *)(file->samples + start) - (const char *)file->map);
+    size_t last = (size_t)((const char *)(file->samples + end) - (const char *)file->map);
+    first = (first + page - 1) / page * page;
+    last = last / page * page;
+    if (last > first) {
+        madvise((char *)file->map + first, last - first, MADV_DONTNEED);
+    }
+}
+
+// Streams the mapped samples through the device in chunks of engine->chunk_size
+// (or SAMPLE_CHUNK_POINTS) points with the composite rule of the given mode.
+// Two slots alternate, each with its own queue: while one slot's chunk is
+// transferred and reduced, the host fills the other. GPUs get a pinned
+// CL_MEM_ALLOC_HOST_PTR staging buffer per slot; CPU devices read the mapping
+// in place through CL_MEM_USE_HOST_PTR. elapsed_time receives the wall time;
+// returns 0, or -1 if a slot cannot be set up or a chunk cannot be enqueued.
+int run_samples(OpenCLEngine* engine, const SampleFile* file, double a, double b, int mode, double* final_result, double* elapsed_time) {
+    if (mode < 0 || mode > 2) {
+        fprintf(stderr, "Invalid mode selected.\n");
+        return -1;
+    }
+
+    cl_command_queue queues[SAMPLE_BUFFERS];
+    cl_kernel sample_kernels[SAMPLE_BUFFERS];
+    cl_kernel final_sum_kernels[SAMPLE_BUFFERS];
+    cl_mem input_mem[SAMPLE_BUFFERS];
+    cl_mem partial_sums_mem[SAMPLE_BUFFERS];
+    cl_mem chunk_sum_mem[SAMPLE_BUFFERS];
+    cl_event read_events[SAMPLE_BUFFERS];
+    cl_event write_events[SAMPLE_BUFFERS];
+    cl_event sample_events[SAMPLE_BUFFERS];
+    cl_event reduce_events[SAMPLE_BUFFERS];
+    double chunk_sums[SAMPLE_BUFFERS][2];
+    long long chunk_start[SAMPLE_BUFFERS];
+    long long chunk_end[SAMPLE_BUFFERS];
+    int in_flight[SAMPLE_BUFFERS] = { 0 };
+    int status = 0;
+    cl_int ret;
+
+    cl_device_type device_type;
+    clGetDeviceInfo(engine->device_id, CL_DEVICE_TYPE, sizeof(device_type), &device_type, NULL);
+    // The fp32 variant reads floats, so its chunks are always narrowed
+    // through the staging buffer.
+    int narrow = engine->real_size != sizeof(double);
+    int zero_copy = (device_type & CL_DEVICE_TYPE_CPU) != 0 && !narrow;
+
+    // CL_MEM_USE_HOST_PTR only avoids a copy when the pointer meets the
+    // device's base address alignment (reported in bits). Chunk boundaries are
+    // placed on that alignment: a short head chunk covers the points before
+    // the first aligned address (e.g. after the 64-byte header) and is copied,
+    // and every later chunk is a whole number of aligned blocks.
+    cl_uint align_bits = 0;
+    clGetDeviceInfo(engine->device_id, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(align_bits), &align_bits, NULL);
+    size_t align_bytes = align_bits / 8 > sizeof(double) * 8 ? align_bits / 8 : sizeof(double) * 8;
+    size_t misalign = (uintptr_t)file->samples % align_bytes;
+    if (misalign % sizeof(double) != 0) {
+        zero_copy = 0;
+    }
+    long long head_points = zero_copy && misalign > 0 ? (long long)((align_bytes - misalign) / sizeof(double)) : 0;
+    if (head_points > file->count) {
+        head_points = file->count;
+    }
+
+    long long align_points = (long long)(align_bytes / sizeof(double));
+    long long chunk_points = engine->chunk_size > 0 ? engine->chunk_size : SAMPLE_CHUNK_POINTS;
+    chunk_points = (chunk_points + align_points - 1) / align_points * align_points;
+    if (chunk_points > file->count) {
+        chunk_points = file->count;
+    }
+
+    size_t local_item_size = engine->local_size;
+    size_t max_groups = kernel_global_size(engine, chunk_points) / local_item_size;
+
+    for (int s = 0; s < SAMPLE_BUFFERS; s++) {
+        queues[s] = NULL;
+        sample_kernels[s] = NULL;
+        final_sum_kernels[s] = NULL;
+        partial_sums_mem[s] = NULL;
+        chunk_sum_mem[s] = NULL;
+        input_mem[s] = NULL;
+    }
+    for (int s = 0; s < SAMPLE_BUFFERS && status == 0; s++) {
+        queues[s] = clCreateCommandQueue(engine->context, engine->device_id, CL_QUEUE_PROFILING_ENABLE, &ret);
+        if (ret == CL_SUCCESS) {
+            sample_kernels[s] = clCreateKernel(engine->program, "sample_integral", &ret);
+        }
+        if (ret == CL_SUCCESS) {
+            final_sum_kernels[s] = clCreateKernel(engine->program, "final_sum_kernel", &ret);
+        }
+        if (ret == CL_SUCCESS) {
+            partial_sums_mem[s] = clCreateBuffer(engine->context, CL_MEM_READ_WRITE, max_groups * 2 * engine->real_size, NULL, &ret);
+        }
+        if (ret == CL_SUCCESS) {
+            chunk_sum_mem[s] = clCreateBuffer(engine->context, CL_MEM_READ_WRITE, 2 * engine->real_size, NULL, &ret);
+        }
+        if (ret == CL_SUCCESS && !zero_copy) {
+            input_mem[s] = clCreateBuffer(engine->context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, chunk_points * engine->real_size, NULL, &ret);
+        }
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to set up sample slot %d. Error: %d\n", s, ret);
+            status = -1;
+        }
+    }
+
+    double total = 0.0;
+    double comp = 0.0;
+    long long n = file->count - 1;
+
+    struct timespec start_t, end_t;
+    clock_gettime(CLOCK_MONOTONIC, &start_t);
+
+    long long chunk = 0;
+    long long end;
+    for (long long start = 0; status == 0 && start < file->count; start = end, chunk++) {
+        int s = (int)(chunk % SAMPLE_BUFFERS);
+        end = start == 0 && head_points > 0 ? head_points : start + chunk_points;
+        if (end > file->count) {
+            end = file->count;
+        }
+        size_t bytes = (size_t)(end - start) * sizeof(double);
+
+        // The slot is reused: collect its previous chunk first.
+        if (in_flight[s]) {
+            clWaitForEvents(1, &read_events[s]);
+            trace_collect("write chunk", &write_events[s]);
+            trace_collect("sample_integral", &sample_events[s]);
+            trace_collect("final_sum_kernel", &reduce_events[s]);
+            trace_command("read chunk sum", read_events[s]);
+            clReleaseEvent(read_events[s]);
+            widen_reals(engine, chunk_sums[s], 2);
+            neumaier_add(&total, &comp, chunk_sums[s][0]);
+            comp += chunk_sums[s][1];
+            in_flight[s] = 0;
+            if (zero_copy) {
+                clReleaseMemObject(input_mem[s]);
+                input_mem[s] = NULL;
+                drop_samples(file, chunk_start[s], chunk_end[s]);
+            }
+        }
+
+        double trace_start = trace_now();
+        write_events[s] = NULL;
+        if (zero_copy) {
+            cl_mem_flags host_flag = start < head_points ? CL_MEM_COPY_HOST_PTR : CL_MEM_USE_HOST_PTR;
+            input_mem[s] = clCreateBuffer(engine->context, CL_MEM_READ_ONLY | host_flag, bytes, (void *)(file->samples + start), &ret);
+        } else {
+            // The map waits for nothing: this slot's previous kernel has been
+            // collected above, and the other slot keeps the device busy.
+            size_t staged_bytes = (size_t)(end - start) * engine->real_size;
+            void *staging = clEnqueueMapBuffer(queues[s], input_mem[s], CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, 0, staged_bytes, 0, NULL, NULL, &ret);
+            if (ret == CL_SUCCESS && narrow) {
+                float *values = (float *)staging;
+                for (long long i = start; i < end; i++) {
+                    values[i - start] = (float)file->samples[i];
+                }
+            } else if (ret == CL_SUCCESS) {
+                memcpy(staging, file->samples + start, bytes);
+            }
+            if (ret == CL_SUCCESS) {
+                ret = clEnqueueUnmapMemObject(queues[s], input_mem[s], staging, 0, NULL, trace_slot(&write_events[s]));
+            }
+            drop_samples(file, start, end);
+        }
+        trace_host("stage chunk", trace_start);
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to stage sample chunk %lld. Error: %d\n", chunk, ret);
+            status = -1;
+            break;
+        }
+        chunk_start[s] = start;
+        chunk_end[s] = end;
+
+        size_t global_item_size = kernel_global_size(engine, end - start);
+        size_t reduce_item_size = local_item_size;
+        cl_long group_count = (cl_long)(global_item_size / local_item_size);
+        cl_long chunk_first = start;
+        cl_long chunk_last = end;
+        cl_long intervals = n;
+
+        ret = clSetKernelArg(sample_kernels[s], 0, sizeof(cl_mem), (void *)&input_mem[s]);
+        ret |= clSetKernelArg(sample_kernels[s], 1, sizeof(cl_long), (void *)&chunk_first);
+        ret |= clSetKernelArg(sample_kernels[s], 2, sizeof(cl_long), (void *)&chunk_last);
+        ret |= clSetKernelArg(sample_kernels[s], 3, sizeof(cl_long), (void *)&intervals);
+        ret |= clSetKernelArg(sample_kernels[s], 4, sizeof(int), (void *)&mode);
+        ret |= clSetKernelArg(sample_kernels[s], 5, sizeof(int), (void *)&engine->compensated);
+        ret |= clSetKernelArg(sample_kernels[s], 6, sizeof(cl_mem), (void *)&partial_sums_mem[s]);
+        ret |= clSetKernelArg(sample_kernels[s], 7, local_item_size * engine->real_size, NULL);
+        ret |= clSetKernelArg(sample_kernels[s], 8, local_item_size * engine->real_size, NULL);
+        ret |= clSetKernelArg(final_sum_kernels[s], 0, sizeof(cl_mem), (void *)&partial_sums_mem[s]);
+        ret |= clSetKernelArg(final_sum_kernels[s], 1, sizeof(cl_long), (void *)&group_count);
+        ret |= clSetKernelArg(final_sum_kernels[s], 2, sizeof(int), (void *)&engine->compensated);
+        ret |= clSetKernelArg(final_sum_kernels[s], 3, sizeof(cl_mem), (void *)&chunk_sum_mem[s]);
+        ret |= clSetKernelArg(final_sum_kernels[s], 4, local_item_size * engine->real_size, NULL);
+        ret |= clSetKernelArg(final_sum_kernels[s], 5, local_item_size * engine->real_size, NULL);
+
+        // One work-group strides over the chunk's partial pairs.
+        ret |= clEnqueueNDRangeKernel(queues[s], sample_kernels[s], 1, NULL, &global_item_size, &local_item_size, 0, NULL, trace_slot(&sample_events[s]));
+        ret |= clEnqueueNDRangeKernel(queues[s], final_sum_kernels[s], 1, NULL, &reduce_item_size, &local_item_size, 0, NULL, trace_slot(&reduce_events[s]));
+        if (ret == CL_SUCCESS) {
+            ret = clEnqueueReadBuffer(queues[s], chunk_sum_mem[s], CL_FALSE, 0, 2 * engine->real_size, chunk_sums[s], 0, NULL, &read_events[s]);
+        }
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to enqueue sample chunk %lld. Error: %d\n", chunk, ret);
+            status = -1;
+            break;
+        }
+        clFlush(queues[s]);
+        in_flight[s] = 1;
+    }
+
+    for (int s = 0; s < SAMPLE_BUFFERS; s++) {
+        if (in_flight[s]) {
+            clWaitForEvents(1, &read_events[s]);
+            trace_collect("write chunk", &write_events[s]);
+            trace_collect("sample_integral", &sample_events[s]);
+            trace_collect("final_sum_kernel", &reduce_events[s]);
+            trace_command("read chunk sum", read_events[s]);
+            clReleaseEvent(read_events[s]);
+            widen_reals(engine, chunk_sums[s], 2);
+            neumaier_add(&total, &comp, chunk_sums[s][0]);
+            comp += chunk_sums[s][1];
+            if (zero_copy) {
+                clReleaseMemObject(input_mem[s]);
+                input_mem[s] = NULL;
+                drop_samples(file, chunk_start[s], chunk_end[s]);
+            }
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end_t);
+
+    // A chunk that failed to enqueue may have left commands on its queue.
+    for (int s = 0; s < SAMPLE_BUFFERS; s++) {
+        if (queues[s] != NULL) {
+            clFinish(queues[s]);
+        }
+        release_mem(input_mem[s]);
+        release_mem(partial_sums_mem[s]);
+        release_mem(chunk_sum_mem[s]);
+        if (sample_kernels[s] != NULL) {
+            clReleaseKernel(sample_kernels[s]);
+        }
+        if (final_sum_kernels[s] != NULL) {
+            clReleaseKernel(final_sum_kernels[s]);
+        }
+        if (queues[s] != NULL) {
+            clReleaseCommandQueue(queues[s]);
+        }
+    }
+
+    double h = (b - a) / n;
+    *final_result = rule_factor(mode, h) * (total + comp);
+    *elapsed_time = get_elapsed_time(start_t, end_t);
+    return status;
+}
@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "serve_utils.h"
+#include "batch_utils.h"
+#include "bench_utils.h"
+#include "opencl_utils.h"
+#include "input_utils.h"
+
+// A connection (or stdin/stdout) with its partial input line and the replies
+// not yet written. Socket connections are non-blocking, so a client that does
+// not read only grows its own pending output and never stalls the others.
+typedef struct {
+    int in_fd;
+    int out_fd;
+    char buffer[SERVE_LINE_SIZE];
+    size_t length;
+    char *pending;
+    size_t pending_length;
+    size_t pending_capacity;
+    int broken;     // write failed or SERVE_MAX_PENDING exceeded; closed by the loop
+    int hung_up;    // input ended; closed by the loop once every reply is written
+} ServeClient;
+
+typedef struct {
+    OpenCLEngine *engine;
+    const Options *options;
+    ServeRequest queue[SERVE_MAX_BATCH];
+    int count;
+    ServeClient clients[SERVE_MAX_CLIENTS];
+    int client_count;
+    double latencies[SERVE_LATENCY_WINDOW];    // ring of the most recent latencies
+    long long served;
+    long long batches;
+} ServeState;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop(int signal_number) {
+    stop_requested = 1;
+}
+
+static double now_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1000000000.0;
+}
+
+// Writes as much pending output as the descriptor takes without blocking.
+static void flush_output(ServeClient *client) {
+    size_t offset = 0;
+    while (offset < client->pending_length) {
+        ssize_t written = write(client->out_fd, client->pending + offset, client->pending_length - offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (written <= 0) {
+            client->broken = 1;
+            offset = client->pending_length;
+            break;
+        }
+        offset += (size_t)written;
+    }
+    client->pending_length -= offset;
+    memmove(client->pending, client->pending + offset, client->pending_length);
+}
+
+static void send_line(ServeClient *client, const char *line) {
+    size_t length = strlen(line);
+    if (client->broken) {
+        return;
+    }
+    if (client->pending_length + length > SERVE_MAX_PENDING) {
+        fprintf(stderr, "Dropping a client that stopped reading its replies\n");
+        client->broken = 1;
+        return;
+    }
+    if (client->pending_length + length > client->pending_capacity) {
+        size_t capacity = 2 * (client->pending_length + length);
+        char *grown = (char *)realloc(client->pending, capacity);
+        if (grown == NULL) {
+            client->broken = 1;
+            return;
+        }
+        client->pending = grown;
+        client->pending_capacity = capacity;
+    }
+    memcpy(client->pending + client->pending_length, line, length);
+    client->pending_length += length;
+    flush_output(client);
+}
+
+static ServeClient* find_client(ServeState *state, int out_fd) {
+    for (int i = 0; i < state->client_count; i++) {
+        if (state->clients[i].out_fd == out_fd) {
+            return &state->clients[i];
+        }
+    }
+    return NULL;
+}
+
+// Runs every queued request as one batched launch and answers each with
+// "<value> <latency_us> <batch_size>", latency measured from line arrival,
+// or with an error line if the launch fails; the server keeps running.
+static void flush_batch(ServeState *state) {
+    if (state->count == 0) {
+        return;
+    }
+
+    Params params[SERVE_MAX_BATCH];
+    double results[SERVE_MAX_BATCH];
+    for (int i = 0; i < state->count; i++) {
+        params[i] = state->queue[i].params;
+    }
+
+    double kernel_time;
+    int failed = run_batch(state->engine, params, state->count, results, &kernel_time) != 0;
+    double done = now_seconds();
+
+    for (int i = 0; i < state->count; i++) {
+        double latency = done - state->queue[i].arrival;
+        char line[128];
+        if (failed) {
+            snprintf(line, sizeof(line), "error batch failed on the device\n");
+        } else {
+            snprintf(line, sizeof(line), "%.17g %.1f %d\n", results[i], latency * 1e6, state->count);
+        }
+        ServeClient *client = find_client(state, state->queue[i].fd);
+        if (client != NULL) {
+            send_line(client, line);
+        }
+        state->latencies[state->served++ % SERVE_LATENCY_WINDOW] = latency;
+    }
+
+    state->batches++;
+    state->count = 0;
+}
+
+static void queue_request(ServeState *state, const char *line, ServeClient *client, double arrival) {
+    if (line[strspn(line, " \t\r")] == '\0') {
+        return;     // blank line
+    }
+
+    Params params;
+    int fields = sscanf(line, "%lf %lf %lld %d %d", &params.a, &params.b, &params.n, &params.mode, &params.func);
+    if (fields == 4 && state->options->expr != NULL) {
+        params.func = 0;
+        fields = 5;
+    }
+    if (fields != 5 || params.n <= 0 || params.mode < 0 || params.mode > 2) {
+        send_line(client, "error expected 'a b n mode func' with n > 0 and mode 0-2\n");
+        return;
+    }
+
+    ServeRequest *request = &state->queue[state->count++];
+    request->params = params;
+    request->fd = client->out_fd;
+    request->arrival = arrival;
+
+    if (state->count == SERVE_MAX_BATCH) {
+        flush_batch(state);
+    }
+}
+
+// Reads what is available and queues every complete line. Returns -1 once
+// the peer has closed its end, after queuing a last line that had no newline.
+static int read_client(ServeState *state, ServeClient *client) {
+    ssize_t received = read(client->in_fd, client->buffer + client->length, sizeof(client->buffer) - 1 - client->length);
+    if (received < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+    if (received <= 0) {
+        if (client->length > 0) {
+            client->buffer[client->length] = '\0';
+            queue_request(state, client->buffer, client, now_seconds());
+            client->length = 0;
+        }
+        return -1;
+    }
+
+    double arrival = now_seconds();
+    client->length += (size_t)received;
+    client->buffer[client->length] = '\0';
+
+    char *line = client->buffer;
+    char *newline;
+    while ((newline = strchr(line, '\n')) != NULL) {
+        *newline = '\0';
+        queue_request(state, line, client, arrival);
+        line = newline + 1;
+    }
+
+    client->length = strlen(line);
+    memmove(client->buffer, line, client->length + 1);
+    if (client->length == sizeof(client->buffer) - 1) {
+        send_line(client, "error line too long\n");
+        client->length = 0;
+    }
+    return 0;
+}
+
+// Queued requests of a dropped connection are discarded, so a reused file
+// descriptor never receives another client's answers.
+static void drop_requests(ServeState *state, int fd) {
+    int kept = 0;
+    for (int i = 0; i < state->count; i++) {
+        if (state->queue[i].fd != fd) {
+            state->queue[kept++] = state->queue[i];
+        }
+    }
+    state->count = kept;
+}
+
+static void add_client(ServeState *state, int in_fd, int out_fd) {
+    ServeClient *client = &state->clients[state->client_count++];
+    memset(client, 0, sizeof(*client));
+    client->in_fd = in_fd;
+    client->out_fd = out_fd;
+}
+
+// Drops the client's queued requests and closes it (stdin/stdout stay open).
+static void remove_client(ServeState *state, int index) {
+    ServeClient *client = &state->clients[index];
+    drop_requests(state, client->out_fd);
+    if (client->in_fd != STDIN_FILENO) {
+        close(client->in_fd);
+    }
+    free(client->pending);
+    state->clients[index] = state->clients[--state->client_count];
+}
+
+static int open_socket(const char *socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+        perror(socket_path);
+        close(listen_fd);
+        return -1;
+    }
+    return listen_fd;
+}
+
+// Serves line-delimited "a b n mode func" requests from stdin (socket_path
+// NULL) or from any number of Unix socket connections, with one warm engine.
+// Requests that arrive within SERVE_BATCH_WINDOW_US of the oldest queued one
+// share a batched launch. Runs until stdin closes or SIGINT/SIGTERM.
+int run_server(OpenCLEngine* engine, const Options* options, const char* socket_path) {
+    int listen_fd = -1;
+
+    ServeState *state = (ServeState *)calloc(1, sizeof(ServeState));
+    if (state == NULL) {
+        fprintf(stderr, "Failed to allocate server state.\n");
+        return -1;
+    }
+    state->engine = engine;
+    state->options = options;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    if (socket_path != NULL) {
+        listen_fd = open_socket(socket_path);
+        if (listen_fd < 0) {
+            free(state);
+            return -1;
+        }
+        fprintf(stderr, "Listening on %s\n", socket_path);
+    } else {
+        add_client(state, STDIN_FILENO, STDOUT_FILENO);
+    }
+
+    double window = SERVE_BATCH_WINDOW_US / 1e6;
+    while (!stop_requested && (listen_fd >= 0 || state->client_count > 0)) {
+        fd_set read_set, write_set;
+        FD_ZERO(&read_set);
+        FD_ZERO(&write_set);
+        int max_fd = -1;
+        if (listen_fd >= 0) {
+            FD_SET(listen_fd, &read_set);
+            max_fd = listen_fd;
+        }
+        for (int i = 0; i < state->client_count; i++) {
+            ServeClient *client = &state->clients[i];
+            if (!client->hung_up) {
+                FD_SET(client->in_fd, &read_set);
+                if (client->in_fd > max_fd) {
+                    max_fd = client->in_fd;
+                }
+            }
+            if (client->pending_length > 0) {
+                FD_SET(client->out_fd, &write_set);
+                if (client->out_fd > max_fd) {
+                    max_fd = client->out_fd;
+                }
+            }
+        }
+
+        struct timeval timeout;
+        struct timeval *timeout_ptr = NULL;
+        if (state->count > 0) {
+            double wait = state->queue[0].arrival + window - now_seconds();
+            if (wait < 0.0) {
+                wait = 0.0;
+            }
+            timeout.tv_sec = (time_t)wait;
+            timeout.tv_usec = (suseconds_t)((wait - timeout.tv_sec) * 1e6);
+            timeout_ptr = &timeout;
+        }
+
+        int ready = select(max_fd + 1, &read_set, &write_set, NULL, timeout_ptr);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("select");
+            break;
+        }
+
+        // select() cannot watch descriptors at or above FD_SETSIZE.
+        if (listen_fd >= 0 && FD_ISSET(listen_fd, &read_set)) {
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd >= 0 && fd < FD_SETSIZE && state->client_count < SERVE_MAX_CLIENTS) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                add_client(state, fd, fd);
+            } else if (fd >= 0) {
+                const char *message = "error too many clients\n";
+                send(fd, message, strlen(message), MSG_DONTWAIT);
+                close(fd);
+            }
+        }
+
+        for (int i = 0; i < state->client_count; i++) {
+            ServeClient *client = &state->clients[i];
+            if (FD_ISSET(client->out_fd, &write_set)) {
+                flush_output(client);
+            }
+            // A client that hung up still gets the answers to everything it
+            // sent; it is closed below once they are written.
+            if (!client->hung_up && FD_ISSET(client->in_fd, &read_set) && read_client(state, client) != 0) {
+                client->hung_up = 1;
+                flush_batch(state);
+            }
+        }
+
+        if (state->count > 0 && now_seconds() - state->queue[0].arrival >= window) {
+            flush_batch(state);
+        }
+
+        for (int i = 0; i < state->client_count; i++) {
+            ServeClient *client = &state->clients[i];
+            if (client->broken || (client->hung_up && client->pending_length == 0)) {
+                remove_client(state, i);
+                i--;
+            }
+        }
+    }
+
+    flush_batch(state);
+
+    if (state->served > 0) {
+        int samples = state->served < SERVE_LATENCY_WINDOW ? (int)state->served : SERVE_LATENCY_WINDOW;
+        BenchStats stats;
+        summarize_samples(state->latencies, samples, &stats);
+        fprintf(stderr, "Served %lld requests in %lld batches; latency median %.1f us, p95 %.1f us (last %d requests)\n",
+                state->served, state->batches, stats.median * 1e6, stats.p95 * 1e6, samples);
+    }
+
+    while (state->client_count > 0) {
+        remove_client(state, 0);
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path);
+    }
+    free(state);
+    return 0;
+}
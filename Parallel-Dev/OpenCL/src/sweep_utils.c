@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <CL/cl.h>
+#include "sweep_utils.h"
+#include "opencl_utils.h"
+#include "input_utils.h"
+#include "trace_utils.h"
+
+// Parameter values, whitespace separated. Returns the count, or -1.
+int read_sweep_values(const char *filename, double **values) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        fprintf(stderr, "File couldn't be opened: %s\n", filename);
+        return -1;
+    }
+
+    int count = 0;
+    int capacity = 1024;
+    *values = (double *)malloc(capacity * sizeof(double));
+    if (*values == NULL) {
+        fprintf(stderr, "Failed to allocate memory for parameters.\n");
+        fclose(file);
+        return -1;
+    }
+
+    double value;
+    while (fscanf(file, "%lf", &value) == 1) {
+        if (count == capacity) {
+            double *grown = (double *)realloc(*values, 2 * capacity * sizeof(double));
+            if (grown == NULL) {
+                fprintf(stderr, "Failed to allocate memory for parameters.\n");
+                free(*values);
+                *values = NULL;
+                fclose(file);
+                return -1;
+            }
+            *values = grown;
+            capacity *= 2;
+        }
+        (*values)[count++] = value;
+    }
+
+    fclose(file);
+    return count;
+}
+
+// Exact value of the built-in func(p * x) over [a, b], substituting u = p * x.
+double sweep_exact(double a, double b, double p, int func) {
+    if (p == 0.0) {
+        return (func == 1 || func == 2) ? b - a : 0.0; // cos(0) = exp(0) = 1
+    }
+    return exact_integral(p * a, p * b, func) / p;
+}
+
+// One sweep_integral launch over a (groups per row) x (count rows) grid, one
+// segmented reduction launch and a single readback of the count results.
+// Rows share the work-group budget, so long sweeps get one group per row.
+// elapsed_time receives the kernel time; returns 0, or -1 on failure.
+int run_sweep(OpenCLEngine* engine, double a, double b, long long n, int mode, int func, const double* values, int count, double* results, double* elapsed_time) {
+    if (mode < 0 || mode > 2 || n <= 0 || count <= 0) {
+        fprintf(stderr, "Invalid sweep.\n");
+        return -1;
+    }
+
+    size_t groups_per_row = kernel_global_size(engine, n + 1) / engine->local_size;
+    if (groups_per_row > MAX_GROUPS_PER_ROW) {
+        groups_per_row = MAX_GROUPS_PER_ROW;
+    }
+    size_t row_budget = MAX_WORK_GROUPS / (size_t)count;
+    if (groups_per_row > row_budget) {
+        groups_per_row = row_budget > 0 ? row_budget : 1;
+    }
+
+    int *group_offsets = (int *)malloc((count + 1) * sizeof(int));
+    double *pairs = (double *)malloc(count * 2 * sizeof(double));
+    if (!group_offsets || !pairs) {
+        fprintf(stderr, "Failed to allocate sweep of %d parameters.\n", count);
+        free(group_offsets);
+        free(pairs);
+        return -1;
+    }
+    for (int r = 0; r <= count; r++) {
+        group_offsets[r] = (int)(r * groups_per_row);
+    }
+
+    size_t local_item_size[2] = { engine->local_size, 1 };
+    size_t global_item_size[2] = { groups_per_row * engine->local_size, (size_t)count };
+    double h = (b - a) / n;
+    cl_long points = n;
+
+    cl_int ret;
+    cl_kernel sweep_kernel = NULL, segmented_kernel = NULL;
+    cl_mem params_mem = NULL, offsets_mem = NULL, partial_sums_mem = NULL, row_sums_mem = NULL;
+    cl_event sweep_event = NULL, segmented_event = NULL, read_event = NULL;
+    int status = -1;
+
+    sweep_kernel = clCreateKernel(engine->program, "sweep_integral", &ret);
+    if (ret == CL_SUCCESS) {
+        segmented_kernel = clCreateKernel(engine->program, "segmented_sum_kernel", &ret);
+    }
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create sweep kernels. Error: %d\n", ret);
+    } else {
+        params_mem = create_real_buffer(engine, values, count, &ret);
+        if (ret == CL_SUCCESS) {
+            offsets_mem = clCreateBuffer(engine->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, (count + 1) * sizeof(int), group_offsets, &ret);
+        }
+        if (ret == CL_SUCCESS) {
+            partial_sums_mem = clCreateBuffer(engine->context, CL_MEM_READ_WRITE, count * groups_per_row * 2 * engine->real_size, NULL, &ret);
+        }
+        if (ret == CL_SUCCESS) {
+            row_sums_mem = clCreateBuffer(engine->context, CL_MEM_WRITE_ONLY, count * 2 * engine->real_size, NULL, &ret);
+        }
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to create sweep buffers. Error: %d\n", ret);
+        }
+    }
+
+    if (ret == CL_SUCCESS) {
+        ret = set_real_arg(engine, sweep_kernel, 0, a);
+        ret |= set_real_arg(engine, sweep_kernel, 1, h);
+        ret |= clSetKernelArg(sweep_kernel, 2, sizeof(cl_long), (void *)&points);
+        ret |= clSetKernelArg(sweep_kernel, 3, sizeof(int), (void *)&mode);
+        ret |= clSetKernelArg(sweep_kernel, 4, sizeof(int), (void *)&func);
+        ret |= clSetKernelArg(sweep_kernel, 5, sizeof(cl_mem), (void *)&params_mem);
+        ret |= clSetKernelArg(sweep_kernel, 6, sizeof(int), (void *)&engine->compensated);
+        ret |= clSetKernelArg(sweep_kernel, 7, sizeof(cl_mem), (void *)&partial_sums_mem);
+        ret |= clSetKernelArg(sweep_kernel, 8, local_item_size[0] * engine->real_size, NULL);
+        ret |= clSetKernelArg(sweep_kernel, 9, local_item_size[0] * engine->real_size, NULL);
+
+        ret |= clSetKernelArg(segmented_kernel, 0, sizeof(cl_mem), (void *)&partial_sums_mem);
+        ret |= clSetKernelArg(segmented_kernel, 1, sizeof(cl_mem), (void *)&offsets_mem);
+        ret |= clSetKernelArg(segmented_kernel, 2, sizeof(int), (void *)&engine->compensated);
+        ret |= clSetKernelArg(segmented_kernel, 3, sizeof(cl_mem), (void *)&row_sums_mem);
+        ret |= clSetKernelArg(segmented_kernel, 4, local_item_size[0] * engine->real_size, NULL);
+        ret |= clSetKernelArg(segmented_kernel, 5, local_item_size[0] * engine->real_size, NULL);
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to set sweep kernel arguments. Error: %d\n", ret);
+        }
+    }
+
+    if (ret == CL_SUCCESS) {
+        size_t segmented_item_size = (size_t)count * local_item_size[0];
+        ret = clEnqueueNDRangeKernel(engine->command_queue, sweep_kernel, 2, NULL, global_item_size, local_item_size, 0, NULL, &sweep_event);
+        if (ret == CL_SUCCESS) {
+            ret = clEnqueueNDRangeKernel(engine->command_queue, segmented_kernel, 1, NULL, &segmented_item_size, &local_item_size[0], 0, NULL, &segmented_event);
+        }
+        if (ret == CL_SUCCESS) {
+            ret = clEnqueueReadBuffer(engine->command_queue, row_sums_mem, CL_TRUE, 0, count * 2 * engine->real_size, pairs, 0, NULL, trace_slot(&read_event));
+        }
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to run sweep kernels. Error: %d\n", ret);
+            clFinish(engine->command_queue);
+        }
+    }
+
+    if (ret == CL_SUCCESS) {
+        trace_command("sweep_integral", sweep_event);
+        trace_command("segmented_sum_kernel", segmented_event);
+        trace_collect("read results", &read_event);
+        widen_reals(engine, pairs, 2 * (size_t)count);
+
+        double factor = rule_factor(mode, h);
+        for (int r = 0; r < count; r++) {
+            results[r] = factor * (pairs[2 * r] + pairs[2 * r + 1]);
+        }
+        *elapsed_time = event_seconds(sweep_event) + event_seconds(segmented_event);
+        status = 0;
+    }
+
+    if (sweep_event != NULL) {
+        clReleaseEvent(sweep_event);
+    }
+    if (segmented_event != NULL) {
+        clReleaseEvent(segmented_event);
+    }
+    if (read_event != NULL) {
+        clReleaseEvent(read_event);
+    }
+    if (sweep_kernel != NULL) {
+        clReleaseKernel(sweep_kernel);
+    }
+    if (segmented_kernel != NULL) {
+        clReleaseKernel(segmented_kernel);
+    }
+    release_mem(params_mem);
+    release_mem(offsets_mem);
+    release_mem(partial_sums_mem);
+    release_mem(row_sums_mem);
+    free(group_offsets);
+    free(pairs);
+
+    return status;
+}
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <CL/cl.h>
+#include "tanh_sinh_utils.h"
+#include "opencl_utils.h"
+#include "input_utils.h"
+#include "trace_utils.h"
+
+// Points t = offset + i * stride, i < count, that stay within TANH_SINH_T_MAX.
+static cl_long level_count(double offset, double stride) {
+    return (cl_long)floor((TANH_SINH_T_MAX - offset) / stride) + 1;
+}
+
+// Sum of the weighted integrand over one level's new points, on the device.
+// Returns 0, or -1 if the launch or the reduction fails.
+static int tanh_sinh_sum(OpenCLEngine* engine, cl_kernel kernel, cl_mem partial_sums_mem, double a, double b, double offset, double stride, cl_long count, int func, double* sum, double* elapsed_time) {
+    size_t local_item_size = engine->local_size;
+    size_t global_item_size = kernel_global_size(engine, count);
+    size_t num_work_groups = global_item_size / local_item_size;
+
+    cl_int ret;
+    ret = set_real_arg(engine, kernel, 0, a);
+    ret |= set_real_arg(engine, kernel, 1, b);
+    ret |= set_real_arg(engine, kernel, 2, offset);
+    ret |= set_real_arg(engine, kernel, 3, stride);
+    ret |= clSetKernelArg(kernel, 4, sizeof(cl_long), (void *)&count);
+    ret |= clSetKernelArg(kernel, 5, sizeof(int), (void *)&func);
+    ret |= clSetKernelArg(kernel, 6, sizeof(int), (void *)&engine->compensated);
+    ret |= clSetKernelArg(kernel, 7, sizeof(cl_mem), (void *)&partial_sums_mem);
+    ret |= clSetKernelArg(kernel, 8, local_item_size * engine->real_size, NULL);
+    ret |= clSetKernelArg(kernel, 9, local_item_size * engine->real_size, NULL);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to set tanh-sinh kernel arguments. Error: %d\n", ret);
+        return -1;
+    }
+
+    cl_event event;
+    ret = clEnqueueNDRangeKernel(engine->command_queue, kernel, 1, NULL, &global_item_size, &local_item_size, 0, NULL, &event);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to enqueue tanh-sinh kernel. Error: %d\n", ret);
+        return -1;
+    }
+    clWaitForEvents(1, &event);
+    trace_command("tanh_sinh_kernel", event);
+    *elapsed_time += event_seconds(event);
+    clReleaseEvent(event);
+
+    return reduce_on_device(engine, partial_sums_mem, num_work_groups, sum, elapsed_time);
+}
+
+// Tanh-sinh (double-exponential) integration. Level 0 has step 1; level k
+// halves the step and adds only the new odd multiples of it, so like Romberg
+// S_k = S_{k-1} / 2 + h_k * (new sum) and nothing is evaluated twice. The
+// transformed integrand decays double-exponentially, so the error roughly
+// squares per level even with singular end points; the run stops when two
+// levels agree to within the tolerance, after TANH_SINH_MIN_LEVELS levels.
+// elapsed_time receives the kernel time; returns 0, or -1 on failure.
+int run_tanh_sinh(OpenCLEngine* engine, double a, double b, double tolerance, int func, double* final_result, double* exact_value, double* error, long long* evaluations, int* levels, double* elapsed_time) {
+    if (!(a < b)) {
+        fprintf(stderr, "Tanh-sinh needs a < b.\n");
+        return -1;
+    }
+
+    cl_int ret;
+    cl_kernel kernel = clCreateKernel(engine->program, "tanh_sinh_kernel", &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create tanh-sinh kernel. Error: %d\n", ret);
+        return -1;
+    }
+
+    // Sized for the last level, which has the most new points.
+    double last_step = ldexp(1.0, -TANH_SINH_MAX_LEVELS);
+    size_t max_groups = kernel_global_size(engine, level_count(last_step, 2.0 * last_step)) / engine->local_size;
+    cl_mem partial_sums_mem = clCreateBuffer(engine->context, CL_MEM_READ_WRITE, max_groups * 2 * engine->real_size, NULL, &ret);
+    if (ret != CL_SUCCESS) {
+        fprintf(stderr, "Failed to create tanh-sinh buffer. Error: %d\n", ret);
+        clReleaseKernel(kernel);
+        return -1;
+    }
+
+    *elapsed_time = 0.0;
+
+    // Level 0: t = 0, +-1, ..., +-TANH_SINH_T_MAX.
+    cl_long count = level_count(0.0, 1.0);
+    double previous;
+    int status = tanh_sinh_sum(engine, kernel, partial_sums_mem, a, b, 0.0, 1.0, count, func, &previous, elapsed_time);
+    *evaluations = 2 * count - 1;
+    *final_result = previous;
+    *levels = 1;
+
+    for (int k = 1; status == 0 && k <= TANH_SINH_MAX_LEVELS; k++) {
+        double h = ldexp(1.0, -k);
+        double sum;
+        count = level_count(h, 2.0 * h);
+        status = tanh_sinh_sum(engine, kernel, partial_sums_mem, a, b, h, 2.0 * h, count, func, &sum, elapsed_time);
+        if (status != 0) {
+            break;
+        }
+        *evaluations += 2 * count;
+
+        double current = 0.5 * previous + h * sum;
+        double change = fabs(current - previous);
+        *final_result = current;
+        *levels = k + 1;
+        previous = current;
+
+        if (k + 1 >= TANH_SINH_MIN_LEVELS && change <= tolerance) {
+            break;
+        }
+    }
+
+    *exact_value = exact_integral(a, b, func);
+    *error = fabs(*final_result - *exact_value);
+
+    clReleaseKernel(kernel);
+    clReleaseMemObject(partial_sums_mem);
+
+    return status;
+}
@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <CL/cl.h>
+#include "trace_utils.h"
+#include "hash_utils.h"
+
+#define TRACE_SUMMARY_NAMES 4
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *trace_path = NULL;
+static struct timespec trace_origin;
+static TraceSpan *spans = NULL;
+static int span_count = 0;
+static int span_capacity = 0;
+
+// Tracing is on when a path is given (--trace) or TRACE_ENV names one. The
+// file is written at exit, so every return path of main is covered.
+void trace_open(const char *path) {
+    if (path == NULL) {
+        path = getenv(TRACE_ENV);
+    }
+    if (path == NULL || path[0] == '\0' || trace_path != NULL) {
+        return;
+    }
+    trace_path = path;
+    clock_gettime(CLOCK_MONOTONIC, &trace_origin);
+    atexit(trace_close);
+}
+
+int trace_enabled(void) {
+    return trace_path != NULL;
+}
+
+double trace_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - trace_origin.tv_sec) * 1e6 + (now.tv_nsec - trace_origin.tv_nsec) / 1e3;
+}
+
+// Out of memory the span is dropped; tracing never stops the integration.
+static void add_span(const TraceSpan *span) {
+    pthread_mutex_lock(&trace_lock);
+    if (span_count == span_capacity) {
+        int capacity = span_capacity == 0 ? 256 : 2 * span_capacity;
+        TraceSpan *grown = (TraceSpan *)realloc(spans, capacity * sizeof(TraceSpan));
+        if (grown == NULL) {
+            fprintf(stderr, "Failed to allocate trace; span dropped.\n");
+            pthread_mutex_unlock(&trace_lock);
+            return;
+        }
+        spans = grown;
+        span_capacity = capacity;
+    }
+    spans[span_count++] = *span;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+// Records a host phase that began at start (a trace_now value) and ends now.
+void trace_host(const char *name, double start) {
+    if (!trace_enabled()) {
+        return;
+    }
+    TraceSpan span;
+    memset(&span, 0, sizeof(span));
+    span.name = name;
+    span.host_start = start;
+    span.host_end = trace_now();
+    add_span(&span);
+}
+
+// Records a completed command with its queued, submit, start and end
+// profiling timestamps. The event stays owned by the caller.
+void trace_command(const char *name, cl_event event) {
+    if (!trace_enabled() || event == NULL) {
+        return;
+    }
+    TraceSpan span;
+    memset(&span, 0, sizeof(span));
+    span.name = name;
+    span.device = 1;
+    span.host_end = trace_now();
+    clGetEventInfo(event, CL_EVENT_COMMAND_QUEUE, sizeof(span.queue), &span.queue, NULL);
+    clGetCommandQueueInfo(span.queue, CL_QUEUE_DEVICE, sizeof(span.device_id), &span.device_id, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED, sizeof(span.queued), &span.queued, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_SUBMIT, sizeof(span.submit), &span.submit, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(span.start), &span.start, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(span.end), &span.end, NULL);
+    add_span(&span);
+}
+
+// For commands that need no event of their own: pass trace_slot(&event) as
+// the event argument, then trace_collect once the command is known to be
+// done. Without tracing no event is created at all.
+cl_event* trace_slot(cl_event *event) {
+    *event = NULL;
+    return trace_enabled() ? event : NULL;
+}
+
+void trace_collect(const char *name, cl_event *event) {
+    if (*event != NULL) {
+        trace_command(name, *event);
+        clReleaseEvent(*event);
+        *event = NULL;
+    }
+}
+
+// Device clocks have their own origin. A command is recorded after it has
+// finished, so host_end - end is an upper bound of the clock offset; the
+// smallest one seen per device is used for all of its commands. One pass
+// fills the table; devices past TRACE_MAX_LANES keep offset 0.
+static int device_offsets(cl_device_id *devices, double *offsets) {
+    int device_count = 0;
+    for (int i = 0; i < span_count; i++) {
+        if (!spans[i].device) {
+            continue;
+        }
+        double candidate = spans[i].host_end - spans[i].end / 1e3;
+        int d = 0;
+        while (d < device_count && devices[d] != spans[i].device_id) {
+            d++;
+        }
+        if (d == device_count) {
+            if (device_count == TRACE_MAX_LANES) {
+                continue;
+            }
+            devices[device_count++] = spans[i].device_id;
+            offsets[d] = candidate;
+        } else if (candidate < offsets[d]) {
+            offsets[d] = candidate;
+        }
+    }
+    return device_count;
+}
+
+static double device_offset(const cl_device_id *devices, const double *offsets, int device_count, cl_device_id device_id) {
+    for (int d = 0; d < device_count; d++) {
+        if (devices[d] == device_id) {
+            return offsets[d];
+        }
+    }
+    return 0.0;
+}
+
+static int queue_lane(cl_command_queue *lanes, int *lane_count, cl_command_queue queue) {
+    for (int i = 0; i < *lane_count; i++) {
+        if (lanes[i] == queue) {
+            return i + 1;
+        }
+    }
+    if (*lane_count == TRACE_MAX_LANES) {
+        return TRACE_MAX_LANES;
+    }
+    lanes[(*lane_count)++] = queue;
+    return *lane_count;
+}
+
+static void print_summary(void) {
+    const char *names[TRACE_SUMMARY_NAMES + 1];
+    double totals[TRACE_SUMMARY_NAMES + 1];
+    int name_count = 0;
+    double first = 0.0, last = 0.0;
+
+    // Time per name in an open-addressed table at most half full, then the
+    // largest few kept by insertion into a short list. Without memory for
+    // the table the summary lists no names.
+    size_t slots = 16;
+    while (slots < 2 * (size_t)span_count) {
+        slots <<= 1;
+    }
+    const char **slot_names = (const char **)calloc(slots, sizeof(const char *));
+    double *slot_totals = (double *)calloc(slots, sizeof(double));
+    if (slot_names != NULL && slot_totals != NULL) {
+        for (int i = 0; i < span_count; i++) {
+            const char *name = spans[i].name;
+            size_t slot = hash_bytes(name, strlen(name), 0) & (slots - 1);
+            while (slot_names[slot] != NULL && strcmp(slot_names[slot], name) != 0) {
+                slot = (slot + 1) & (slots - 1);
+            }
+            slot_names[slot] = name;
+            slot_totals[slot] += spans[i].device ? (spans[i].end - spans[i].start) / 1e9 : (spans[i].host_end - spans[i].host_start) / 1e6;
+        }
+
+        for (size_t slot = 0; slot < slots; slot++) {
+            if (slot_names[slot] == NULL) {
+                continue;
+            }
+            int k = name_count < TRACE_SUMMARY_NAMES ? name_count++ : TRACE_SUMMARY_NAMES;
+            names[k] = slot_names[slot];
+            totals[k] = slot_totals[slot];
+            for (; k > 0 && totals[k] > totals[k - 1]; k--) {
+                const char *swap_name = names[k];
+                double swap_total = totals[k];
+                names[k] = names[k - 1];
+                totals[k] = totals[k - 1];
+                names[k - 1] = swap_name;
+                totals[k - 1] = swap_total;
+            }
+        }
+    }
+    free(slot_names);
+    free(slot_totals);
+
+    for (int i = 0; i < span_count; i++) {
+        if (!spans[i].device && (i == 0 || spans[i].host_start < first)) {
+            first = spans[i].host_start;
+        }
+        if (spans[i].host_end > last) {
+            last = spans[i].host_end;
+        }
+    }
+
+    fprintf(stderr, "Trace: %d spans over %.6f s;", span_count, (last - first) / 1e6);
+    for (int i = 0; i < name_count; i++) {
+        fprintf(stderr, "%s %s %.6f s", i == 0 ? "" : ",", names[i], totals[i]);
+    }
+    fprintf(stderr, "; written to %s\n", trace_path);
+}
+
+// Writes the Chrome trace-event JSON (chrome://tracing, Perfetto): host
+// phases as pid 0, device commands as pid 1 with one thread per queue.
+void trace_close(void) {
+    if (!trace_enabled()) {
+        return;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    FILE *file = fopen(trace_path, "w");
+    if (file == NULL) {
+        perror(trace_path);
+        pthread_mutex_unlock(&trace_lock);
+        return;
+    }
+
+    cl_command_queue lanes[TRACE_MAX_LANES];
+    int lane_count = 0;
+    cl_device_id devices[TRACE_MAX_LANES];
+    double offsets[TRACE_MAX_LANES];
+    int device_count = device_offsets(devices, offsets);
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"host\"}},\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"device\"}}");
+    for (int i = 0; i < span_count; i++) {
+        const TraceSpan *span = &spans[i];
+        if (span->device) {
+            double offset = device_offset(devices, offsets, device_count, span->device_id);
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"device\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                          "\"args\":{\"queued_us\":%.3f,\"submit_us\":%.3f}}",
+                    span->name, queue_lane(lanes, &lane_count, span->queue), span->start / 1e3 + offset, (span->end - span->start) / 1e3,
+                    span->queued / 1e3 + offset, span->submit / 1e3 + offset);
+        } else {
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"host\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f}",
+                    span->name, span->host_start, span->host_end - span->host_start);
+        }
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+
+    print_summary();
+
+    free(spans);
+    spans = NULL;
+    span_count = 0;
+    span_capacity = 0;
+    trace_path = NULL;
+    pthread_mutex_unlock(&trace_lock);
+}
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <CL/cl.h>
+#include "tune_utils.h"
+#include "opencl_utils.h"
+#include "hash_utils.h"
+
+// Every kernel launched with engine->local_size; the tuned size has to fit
+// all of them, not only the one that is timed.
+static const char *sized_kernels[] = {
+    "fused_integral", "final_sum_kernel", "simpson_kernel", "qmc_kernel", "batch_integral", "segmented_sum_kernel", "sample_integral", "gauss_legendre_kernel", "sweep_integral", "tanh_sinh_kernel"
+};
+
+static void get_tuning_path(char *path, size_t path_size) {
+    snprintf(path, path_size, "%s/%s", get_cache_dir(), TUNING_FILE);
+}
+
+// The tuning file holds one "<key> <kernel> <local_size> <items_per_thread>"
+// line per program variant. Entries are appended, so the last match wins.
+int load_tuning(unsigned long long key, const char *kernel_name, size_t *local_size, int *items_per_thread) {
+    char path[1024];
+    get_tuning_path(path, sizeof(path));
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    int found = -1;
+    unsigned long long entry_key;
+    char entry_kernel[64];
+    size_t entry_local;
+    int entry_items;
+    while (fscanf(file, "%llx %63s %zu %d", &entry_key, entry_kernel, &entry_local, &entry_items) == 4) {
+        if (entry_key == key && strcmp(entry_kernel, kernel_name) == 0 && entry_local > 0 && entry_items > 0) {
+            *local_size = entry_local;
+            *items_per_thread = entry_items;
+            found = 0;
+        }
+    }
+
+    fclose(file);
+    return found;
+}
+
+int save_tuning(unsigned long long key, const char *kernel_name, size_t local_size, int items_per_thread) {
+    char path[1024];
+    get_tuning_path(path, sizeof(path));
+
+    mkdir(get_cache_dir(), 0755);
+    FILE *file = fopen(path, "a");
+    if (file == NULL) {
+        return -1;
+    }
+
+    fprintf(file, "%016llx %s %zu %d\n", key, kernel_name, local_size, items_per_thread);
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+// Returns 0 if a kernel cannot be created.
+size_t tuning_size_limit(OpenCLEngine *engine, size_t *preferred_multiple) {
+    size_t limit = MAX_TUNE_LOCAL_SIZE;
+    *preferred_multiple = 1;
+
+    for (size_t i = 0; i < sizeof(sized_kernels) / sizeof(sized_kernels[0]); i++) {
+        cl_int ret;
+        cl_kernel kernel = clCreateKernel(engine->program, sized_kernels[i], &ret);
+        if (ret != CL_SUCCESS) {
+            fprintf(stderr, "Failed to create kernel %s for tuning. Error: %d\n", sized_kernels[i], ret);
+            return 0;
+        }
+
+        size_t max_size = 0, multiple = 1;
+        clGetKernelWorkGroupInfo(kernel, engine->device_id, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_size), &max_size, NULL);
+        if (strcmp(sized_kernels[i], TUNE_KERNEL) == 0) {
+            clGetKernelWorkGroupInfo(kernel, engine->device_id, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(multiple), &multiple, NULL);
+            *preferred_multiple = multiple > 0 ? multiple : 1;
+        }
+        if (max_size > 0 && max_size < limit) {
+            limit = max_size;
+        }
+        clReleaseKernel(kernel);
+    }
+
+    return limit;
+}
+
+// Times fused_integral over TUNE_POINTS points for every power-of-two local
+// size from the preferred multiple up to the kernel limit, and for 1, 4, ...,
+// MAX_ITEMS_PER_THREAD vectors of engine->vector_width points per work-item
+// (single points in the scalar build). The fastest of TUNE_REPEATS runs
+// counts, and the engine keeps the overall winner. Returns -1 on failure,
+// with the engine's previous sizes restored.
+double autotune_engine(OpenCLEngine *engine) {
+    size_t multiple;
+    size_t limit = tuning_size_limit(engine, &multiple);
+    if (limit == 0) {
+        return -1.0;
+    }
+
+    // The reductions halve the group, so only powers of two qualify.
+    size_t local_size = 1;
+    while (local_size < multiple && local_size * 2 <= limit) {
+        local_size <<= 1;
+    }
+
+    long long size = TUNE_POINTS - 1;
+    double h = 1.0 / size;
+    double best_time = -1.0;
+    size_t best_local = engine->local_size;
+    int best_items = engine->items_per_thread;
+
+    for (; local_size <= limit; local_size <<= 1) {
+        for (int items = 1; items <= MAX_ITEMS_PER_THREAD; items *= 4) {
+            engine->local_size = local_size;
+            engine->items_per_thread = items;
+
+            double time = -1.0;
+            for (int r = 0; r < TUNE_REPEATS; r++) {
+                double sum, elapsed_time;
+                if (fused_sum(engine, 0.0, h, size, 0, 0, &sum, &elapsed_time) != 0) {
+                    engine->local_size = best_local;
+                    engine->items_per_thread = best_items;
+                    return -1.0;
+                }
+                if (time < 0.0 || elapsed_time < time) {
+                    time = elapsed_time;
+                }
+            }
+
+            if (best_time < 0.0 || time < best_time) {
+                best_time = time;
+                best_local = local_size;
+                best_items = items;
+            }
+        }
+    }
+
+    engine->local_size = best_local;
+    engine->items_per_thread = best_items;
+    return best_time;
+}
+
+// TUNE_AUTO reuses a stored entry when it still fits the device limits and
+// sweeps otherwise; TUNE_FORCE always sweeps. New results are persisted.
+// Returns -1 if the sweep fails on the device.
+int apply_tuning(OpenCLEngine *engine, int tune) {
+    if (tune == TUNE_OFF) {
+        return 0;
+    }
+
+    if (tune == TUNE_AUTO) {
+        size_t local_size;
+        int items_per_thread;
+        if (load_tuning(engine->program_key, TUNE_KERNEL, &local_size, &items_per_thread) == 0) {
+            size_t multiple;
+            if (local_size <= tuning_size_limit(engine, &multiple) && (local_size & (local_size - 1)) == 0) {
+                engine->local_size = local_size;
+                engine->items_per_thread = items_per_thread;
+                return 0;
+            }
+        }
+    }
+
+    fprintf(stderr, "Tuning %s for this device...\n", TUNE_KERNEL);
+    double best_time = autotune_engine(engine);
+    if (best_time < 0.0) {
+        return -1;
+    }
+    fprintf(stderr, "Tuned: local size %zu, %d points per work-item (%.6f s for %lld points)\n", engine->local_size, engine->items_per_thread * engine->vector_width, best_time, TUNE_POINTS);
+
+    if (save_tuning(engine->program_key, TUNE_KERNEL, engine->local_size, engine->items_per_thread) != 0) {
+        fprintf(stderr, "Warning: could not write tuning file in %s\n", get_cache_dir());
+    }
+    return 0;
+}